@@ -0,0 +1,416 @@
+#pragma once
+
+// Mid hook callbacks. Kept free of Windows and of the rest of the fix so tools/replay can build them
+// on their own and run them against a hook trace.
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <safetyhook.hpp>
+
+// Defined by dllmain.cpp, or by whatever else builds the callbacks.
+extern int iCustomResX;
+extern int iCustomResY;
+extern bool bFixHUD;
+extern bool bHighRefreshRate;
+extern float fAspectRatio;
+extern float fNativeAspect;
+extern float fAspectMultiplier;
+extern float fHUDWidth;
+extern float fCurrentFrametime;
+extern int iWindowMode;
+
+namespace Callbacks
+{
+    // Per-frame steps the framerate unlock rescales, filled in by FrameRate::AddSite.
+    struct Step
+    {
+        int32_t xmm;
+        float step;
+    };
+
+    constexpr size_t MaxSteps = 4;
+    std::array<Step, MaxSteps> Steps{};
+
+    // Game constants the battle marker callback moves. Made writable when the hook is installed.
+    float* BattleMarkerRightValue = nullptr;
+    float* BattleMarkerFlipValue = nullptr;
+
+    // Calls back in to the rest of the fix. Left null when replaying.
+    void (*OnMovie)() = nullptr;
+    void (*OnCustomResolution)(int width, int height) = nullptr;
+
+    // Everything the callbacks read besides the context and probed memory.
+    // Written to hook traces whenever it changes, so a replay runs with the same inputs.
+    struct Inputs
+    {
+        int32_t customResX;
+        int32_t customResY;
+        float aspectRatio;
+        float nativeAspect;
+        float aspectMultiplier;
+        float hudWidth;
+        float currentFrametime;
+        uint8_t fixHUD;
+        uint8_t highRefreshRate;
+        uint8_t padding[2];
+        std::array<Step, MaxSteps> steps;
+    };
+    static_assert(std::is_trivially_copyable_v<Inputs> && sizeof(Inputs) == 64, "Inputs are written to traces as raw bytes.");
+
+    Inputs Capture()
+    {
+        Inputs inputs{};
+        inputs.customResX = iCustomResX;
+        inputs.customResY = iCustomResY;
+        inputs.aspectRatio = fAspectRatio;
+        inputs.nativeAspect = fNativeAspect;
+        inputs.aspectMultiplier = fAspectMultiplier;
+        inputs.hudWidth = fHUDWidth;
+        inputs.currentFrametime = fCurrentFrametime;
+        inputs.fixHUD = bFixHUD;
+        inputs.highRefreshRate = bHighRefreshRate;
+        inputs.steps = Steps;
+        return inputs;
+    }
+
+    void Apply(const Inputs& inputs)
+    {
+        iCustomResX = inputs.customResX;
+        iCustomResY = inputs.customResY;
+        fAspectRatio = inputs.aspectRatio;
+        fNativeAspect = inputs.nativeAspect;
+        fAspectMultiplier = inputs.aspectMultiplier;
+        fHUDWidth = inputs.hudWidth;
+        fCurrentFrametime = inputs.currentFrametime;
+        bFixHUD = inputs.fixHUD;
+        bHighRefreshRate = inputs.highRefreshRate;
+        Steps = inputs.steps;
+    }
+
+    void IntroSkip(SafetyHookContext& ctx)
+    {
+        ctx.rdx = 1;
+    }
+
+    void CustomResolution(SafetyHookContext& ctx)
+    {
+        if (ctx.r8 && ctx.rdx)
+        {
+            // Internal resolution
+            *reinterpret_cast<short*>(ctx.r8) = (short)iCustomResX;
+            *reinterpret_cast<short*>(ctx.r8 + 0x2) = (short)iCustomResY;
+
+            // Window size
+            *reinterpret_cast<short*>(ctx.rdx) = (short)iCustomResX;
+            *reinterpret_cast<short*>(ctx.rdx + 0x2) = (short)iCustomResY;
+
+            if (OnCustomResolution)
+            {
+                OnCustomResolution(iCustomResX, iCustomResY);
+            }
+        }
+    }
+
+    void WindowedMode(SafetyHookContext& ctx)
+    {
+        // Grab window mode
+        iWindowMode = (int)ctx.rax;
+    }
+
+    void HUDWidth(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm0.f32[0] = (float)iCustomResY * fNativeAspect;
+        }
+    }
+
+    void MenuBackgrounds(SafetyHookContext& ctx)
+    {
+        if (ctx.rdi + 0x80)
+        {
+            // Check for 1280x800 background
+            if (*reinterpret_cast<float*>(ctx.rdi + 0x7C) == 1280.00f && *reinterpret_cast<float*>(ctx.rdi + 0x80) == 800.00f)
+            {
+                if (fAspectRatio > fNativeAspect)
+                {
+                    *reinterpret_cast<float*>(ctx.rdi + 0x7C) = 720.00f * fAspectRatio;
+                    *reinterpret_cast<float*>(ctx.rdi + 0x18) = -(((720.00f * fAspectRatio) - 1280.00f) / 2.00f);
+                }
+                else if (fAspectRatio < 1.60f)
+                {
+                    *reinterpret_cast<float*>(ctx.rdi + 0x80) = 1280.00f / fAspectRatio;
+                    *reinterpret_cast<float*>(ctx.rdi + 0x1C) = -(((1280.00f / fAspectRatio) - 720.00f) / 2.00f);
+                }
+            }
+        }
+    }
+
+    void HUDScissor(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm2.f32[0] = fHUDWidth / 1280.00f;
+            ctx.xmm8.f32[0] += ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
+            ctx.xmm9.f32[0] += ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
+        }
+        else if (fAspectRatio < 1.60f)
+        {
+            ctx.xmm6.f32[0] += ((1280.00f / fAspectRatio) - 720.00f) / 2.00f;
+            ctx.xmm7.f32[0] += ((1280.00f / fAspectRatio) - 720.00f) / 2.00f;
+        }
+    }
+
+    void MinimapCompassScale(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm0.f32[0] = fHUDWidth / 1280.00f;
+        }
+    }
+
+    void MinimapCompassWidth(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm7.f32[0] = fHUDWidth;
+        }
+    }
+
+    void MinimapCompassNarrow(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio < 1.60f)
+        {
+            ctx.xmm7.f32[0] = ((1280.00f / fAspectRatio) - 720.00f) / 2.00f;
+        }
+    }
+
+    void MinimapCompassNorth(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm6.f32[0] = -0.05f * fHUDWidth + 72.00f; // Not sure on how they calculated this, but this formula produces very similar results.
+        }
+    }
+
+    void Fades(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            float fWidthOffset = ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
+
+            ctx.xmm1.f32[0] = 0.00f;
+            ctx.xmm2.f32[0] = 720.00f;
+
+            if (ctx.rcx + 0x6D0 && ctx.rcx + 6E0)
+            {
+                *reinterpret_cast<float*>(ctx.rcx + 0x6D0) = -fWidthOffset;
+                *reinterpret_cast<float*>(ctx.rcx + 0x6E0) = -fWidthOffset;
+            }
+        }
+    }
+
+    void FadesSize(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            float fWidthOffset = ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
+
+            if (ctx.rcx + 0x6F0 && ctx.rcx + 0x700)
+            {
+                *reinterpret_cast<float*>(ctx.rcx + 0x6F0) = (720.00f * fAspectRatio) - fWidthOffset;
+                *reinterpret_cast<float*>(ctx.rcx + 0x700) = (720.00f * fAspectRatio) - fWidthOffset;
+            }
+        }
+    }
+
+    void BattleCrossfades(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm3.f32[0] *= fAspectMultiplier;
+        }
+        else if (fAspectRatio < 1.60f)
+        {
+            ctx.xmm3.f32[0] /= fAspectMultiplier;
+        }
+    }
+
+    void MarkersWidth1(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm0.f32[0] = fHUDWidth;
+        }
+    }
+
+    void MarkersWidth2(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm1.f32[0] = fHUDWidth;
+        }
+    }
+
+    void MarkersOffset(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm0.f32[0] -= ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
+        }
+    }
+
+    void MarkersNarrow1(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio < 1.60f)
+        {
+            ctx.rax = ctx.rcx;
+        }
+    }
+
+    void MarkersNarrow2(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio < 1.60f)
+        {
+            ctx.xmm2.f32[0] += 40.00f;
+            ctx.xmm2.f32[0] -= ((1280.00f / fAspectRatio) - 720.00f) / 2.00f; // 40.00f at 1920x1200 for example
+        }
+    }
+
+    void BattleMarkersLeft1(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            // Set left side to 80 - the hud width offset.
+            ctx.xmm3.f32[0] = 80.00f - (((720.00f * fAspectRatio) - 1280.00f) / 2.00f); // -80
+        }
+    }
+
+    void BattleMarkersLeft2(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            // Set left side to 80 - the hud width offset.
+            ctx.xmm1.f32[0] = 80.00f - (((720.00f * fAspectRatio) - 1280.00f) / 2.00f); // 80
+        }
+    }
+
+    void BattleMarkersRight(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            // Need to leave the 80px margin
+            if (BattleMarkerRightValue && BattleMarkerFlipValue)
+            {
+                *BattleMarkerRightValue = 1280.00f + (((720.00f * fAspectRatio) - 1280.00f) / 2.00f);
+                *BattleMarkerFlipValue = 900.00f + (((720.00f * fAspectRatio) - 1280.00f) / 2.00f);
+            }
+            ctx.xmm0.f32[0] = 1200.00f + (((720.00f * fAspectRatio) - 1280.00f) / 2.00f);
+        }
+    }
+
+    void Movie(SafetyHookContext& ctx)
+    {
+        if (bHighRefreshRate && OnMovie)
+        {
+            OnMovie();
+        }
+
+        if (bFixHUD && ctx.rbx)
+        {
+            if (fAspectRatio > fNativeAspect)
+            {
+                *reinterpret_cast<float*>(ctx.rbx) = -1.00f / fAspectMultiplier;
+                *reinterpret_cast<float*>(ctx.rbx + 0x1C) = -1.00f / fAspectMultiplier;
+                *reinterpret_cast<float*>(ctx.rbx + 0x38) = 1.00f / fAspectMultiplier;
+                *reinterpret_cast<float*>(ctx.rbx + 0x54) = 1.00f / fAspectMultiplier;
+            }
+        }
+    }
+
+    void MovieNarrow(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio < 1.60f)
+        {
+            ctx.xmm6.f32[0] = fAspectMultiplier;
+        }
+    }
+
+    void FOV(SafetyHookContext& ctx)
+    {
+        if (fAspectRatio > fNativeAspect)
+        {
+            ctx.xmm2.f32[0] *= 1.00f / fAspectMultiplier;
+        }
+    }
+
+    void ShadowDistance(SafetyHookContext& ctx)
+    {
+        if (ctx.rbx + 0x120)
+        {
+            *reinterpret_cast<float*>(ctx.rbx + 0x120) = 24000.00f; // 4x Shadow draw distance. Default = 6000.
+        }
+    }
+
+    // Replaces the per-frame step just loaded in to Steps[Index].xmm with one scaled to the current frame time.
+    template <size_t Index>
+    void ScaleStep(SafetyHookContext& ctx)
+    {
+        const Step& step = Steps[Index];
+        (&ctx.xmm0)[step.xmm].f32[0] = step.step * fCurrentFrametime * 60.00f;
+    }
+
+    // Hook names as passed to Hooks::CreateMid, used to find the callback for a traced hook.
+    struct Named
+    {
+        std::string_view name;
+        safetyhook::MidHookFn callback;
+    };
+
+    constexpr std::array<Named, 29> All = { {
+        { "Intro Skip", IntroSkip },
+        { "Custom Resolution", CustomResolution },
+        { "Windowed Mode", WindowedMode },
+        { "HUD: HUD Width", HUDWidth },
+        { "HUD: Menu Backgrounds", MenuBackgrounds },
+        { "HUD: HUD Scissor", HUDScissor },
+        { "HUD: Minimap Compass 1", MinimapCompassScale },
+        { "HUD: Minimap Compass 2", MinimapCompassScale },
+        { "HUD: Minimap Compass 3", MinimapCompassWidth },
+        { "HUD: Minimap Compass Narrow", MinimapCompassNarrow },
+        { "HUD: Minimap Compass North", MinimapCompassNorth },
+        { "HUD: Fades", Fades },
+        { "HUD: Fades Size", FadesSize },
+        { "HUD: Battle Crossfades", BattleCrossfades },
+        { "HUD: Markers Width 1", MarkersWidth1 },
+        { "HUD: Markers Width 2", MarkersWidth2 },
+        { "HUD: Markers Offset", MarkersOffset },
+        { "HUD: Markers Narrow 1", MarkersNarrow1 },
+        { "HUD: Markers Narrow 2", MarkersNarrow2 },
+        { "HUD: Battle Markers Left 1", BattleMarkersLeft1 },
+        { "HUD: Battle Markers Left 2", BattleMarkersLeft2 },
+        { "HUD: Battle Markers Right", BattleMarkersRight },
+        { "HUD: Movie", Movie },
+        { "HUD: Movie Narrow", MovieNarrow },
+        { "FOV", FOV },
+        { "Shadow Distance", ShadowDistance },
+        { "High Refresh Rate: Timestep", ScaleStep<0> },
+        { "High Refresh Rate: UI Animation", ScaleStep<1> },
+        { "High Refresh Rate: Fade Step", ScaleStep<2> },
+    } };
+
+    safetyhook::MidHookFn Find(std::string_view name)
+    {
+        for (const auto& [entry, callback] : All)
+        {
+            if (entry == name)
+            {
+                return callback;
+            }
+        }
+        return nullptr;
+    }
+}
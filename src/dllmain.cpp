@@ -4,6 +4,18 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <safetyhook.hpp>
+#include "callbacks.hpp"
+#include "hooks.hpp"
+#include "frame.hpp"
+#include "threads.hpp"
+#include "timing.hpp"
+#include "iocache.hpp"
+#include "framerate.hpp"
+#include "metrics.hpp"
+#include "pool.hpp"
+#include "present.hpp"
+#include "shaders.hpp"
+#include "window.hpp"
 
 HMODULE baseModule = GetModuleHandle(NULL);
 HMODULE thisModule;
@@ -15,6 +27,10 @@ std::string sFixName = "SO4Fix";
 std::string sFixVer = "0.9.1";
 std::string sLogFile = "SO4Fix.log";
 std::string sConfigFile = "SO4Fix.ini";
+std::string sTraceFile = "SO4Fix.trace";
+std::string sIOManifestFile = "SO4Fix_io.manifest";
+std::string sShaderManifestFile = "SO4Fix_shaders.manifest";
+std::string sIOTraceFile = "SO4Fix_io.csv";
 std::string sExeName;
 std::filesystem::path sExePath;
 std::filesystem::path sThisModulePath;
@@ -30,6 +46,26 @@ bool bFixHUD;
 bool bFixFOV;
 bool bFixShadowBug;
 bool bShadowDrawDistance;
+bool bHighRefreshRate;
+int iFramerateCap = 144;
+bool bLowLatency;
+int iMaxFrameLatency = 1;
+bool bAllowTearing = true;
+bool bShaderPrewarm;
+bool bThreadPlacement;
+int iThreadPlacementMode = 1;
+int iMainThreadPriority = 0;
+int iRenderThreadPriority = 1;
+bool bHighResTimers;
+int iTimerSpinMicroseconds = 500;
+bool bIOCache;
+int iIOCacheSizeMB = 2048;
+bool bIOTrace;
+bool bPooledHeap;
+int iPooledHeapReserveMB = 1024;
+bool bLiveMetrics;
+bool bHookTrace;
+int iHookTraceMaxRecords = 100000;
 
 // Aspect ratio + HUD stuff
 float fPi = (float)3.141592653;
@@ -44,8 +80,7 @@ float fHUDWidthOffset;
 float fHUDHeightOffset;
 
 // Variables
-uintptr_t BattleMarkerRightValue;
-uintptr_t BattleMarkerFlipValue;
+int64_t StartupTicks;
 float fCurrentFrametime = 0.0166667f;
 int iWindowMode = 0;
 
@@ -124,6 +159,26 @@ void ReadConfig()
     inipp::get_value(ini.sections["Fix FOV"], "Enabled", bFixFOV);
     inipp::get_value(ini.sections["Fix Shadow Buffer Bug"], "Enabled", bFixShadowBug);
     inipp::get_value(ini.sections["Increase Shadow Draw Distance"], "Enabled", bShadowDrawDistance);
+    inipp::get_value(ini.sections["High Refresh Rate"], "Enabled", bHighRefreshRate);
+    inipp::get_value(ini.sections["High Refresh Rate"], "FramerateCap", iFramerateCap);
+    inipp::get_value(ini.sections["Low Latency"], "Enabled", bLowLatency);
+    inipp::get_value(ini.sections["Low Latency"], "MaxFrameLatency", iMaxFrameLatency);
+    inipp::get_value(ini.sections["Low Latency"], "AllowTearing", bAllowTearing);
+    inipp::get_value(ini.sections["Shader Prewarm"], "Enabled", bShaderPrewarm);
+    inipp::get_value(ini.sections["Thread Placement"], "Enabled", bThreadPlacement);
+    inipp::get_value(ini.sections["Thread Placement"], "Mode", iThreadPlacementMode);
+    inipp::get_value(ini.sections["Thread Placement"], "MainThreadPriority", iMainThreadPriority);
+    inipp::get_value(ini.sections["Thread Placement"], "RenderThreadPriority", iRenderThreadPriority);
+    inipp::get_value(ini.sections["High Resolution Timers"], "Enabled", bHighResTimers);
+    inipp::get_value(ini.sections["High Resolution Timers"], "SpinMicroseconds", iTimerSpinMicroseconds);
+    inipp::get_value(ini.sections["IO Cache"], "Enabled", bIOCache);
+    inipp::get_value(ini.sections["IO Cache"], "CacheSizeMB", iIOCacheSizeMB);
+    inipp::get_value(ini.sections["IO Cache"], "Trace", bIOTrace);
+    inipp::get_value(ini.sections["Pooled Heap"], "Enabled", bPooledHeap);
+    inipp::get_value(ini.sections["Pooled Heap"], "ReserveMB", iPooledHeapReserveMB);
+    inipp::get_value(ini.sections["Live Metrics"], "Enabled", bLiveMetrics);
+    inipp::get_value(ini.sections["Hook Trace"], "Enabled", bHookTrace);
+    inipp::get_value(ini.sections["Hook Trace"], "MaxRecords", iHookTraceMaxRecords);
 
     // Log config parse
     spdlog::info("Config Parse: bCustomRes: {}", bCustomRes);
@@ -135,6 +190,26 @@ void ReadConfig()
     spdlog::info("Config Parse: bFixFOV: {}", bFixFOV);
     spdlog::info("Config Parse: bFixShadowBug: {}", bFixShadowBug);
     spdlog::info("Config Parse: bShadowDrawDistance: {}", bShadowDrawDistance);
+    spdlog::info("Config Parse: bHighRefreshRate: {}", bHighRefreshRate);
+    spdlog::info("Config Parse: iFramerateCap: {}", iFramerateCap);
+    spdlog::info("Config Parse: bLowLatency: {}", bLowLatency);
+    spdlog::info("Config Parse: iMaxFrameLatency: {}", iMaxFrameLatency);
+    spdlog::info("Config Parse: bAllowTearing: {}", bAllowTearing);
+    spdlog::info("Config Parse: bShaderPrewarm: {}", bShaderPrewarm);
+    spdlog::info("Config Parse: bThreadPlacement: {}", bThreadPlacement);
+    spdlog::info("Config Parse: iThreadPlacementMode: {}", iThreadPlacementMode);
+    spdlog::info("Config Parse: iMainThreadPriority: {}", iMainThreadPriority);
+    spdlog::info("Config Parse: iRenderThreadPriority: {}", iRenderThreadPriority);
+    spdlog::info("Config Parse: bHighResTimers: {}", bHighResTimers);
+    spdlog::info("Config Parse: iTimerSpinMicroseconds: {}", iTimerSpinMicroseconds);
+    spdlog::info("Config Parse: bIOCache: {}", bIOCache);
+    spdlog::info("Config Parse: iIOCacheSizeMB: {}", iIOCacheSizeMB);
+    spdlog::info("Config Parse: bIOTrace: {}", bIOTrace);
+    spdlog::info("Config Parse: bPooledHeap: {}", bPooledHeap);
+    spdlog::info("Config Parse: iPooledHeapReserveMB: {}", iPooledHeapReserveMB);
+    spdlog::info("Config Parse: bLiveMetrics: {}", bLiveMetrics);
+    spdlog::info("Config Parse: bHookTrace: {}", bHookTrace);
+    spdlog::info("Config Parse: iHookTraceMaxRecords: {}", iHookTraceMaxRecords);
     spdlog::info("----------");
 
     // Calculate aspect ratio / use desktop res instead
@@ -177,6 +252,143 @@ void ReadConfig()
     spdlog::info("----------");
 }
 
+void HookTrace()
+{
+    if (bHookTrace)
+    {
+        // Must be opened before any hooks are created so they get routed through the trace thunks.
+        if (Hooks::Trace::Open(sThisModulePath / sTraceFile, (uint64_t)iHookTraceMaxRecords))
+        {
+            spdlog::info("Hook Trace: Recording up to {} hook calls to {}", iHookTraceMaxRecords, (sThisModulePath / sTraceFile).string());
+        }
+        else
+        {
+            spdlog::error("Hook Trace: Failed to open {}", (sThisModulePath / sTraceFile).string());
+        }
+    }
+}
+
+void LiveMetrics()
+{
+    if (bLiveMetrics)
+    {
+        // Must be set up before any hooks are created so their calls get counted.
+        if (Metrics::Init())
+        {
+            spdlog::info("Live Metrics: Publishing metrics to shared memory \"Local\\SO4Fix_Metrics\" (version {}, {} bytes).", Metrics::Version, sizeof(Metrics::Block));
+            Metrics::PublishResolution(iCustomResX, iCustomResY, fAspectRatio, fNativeAspect);
+        }
+        else
+        {
+            spdlog::error("Live Metrics: Failed to create shared memory.");
+        }
+    }
+}
+
+void HookArena()
+{
+    // Reserve the hook arena before any hooks are created.
+    if (Hooks::Arena::Init(baseModule))
+    {
+        spdlog::info("Hook Arena: Reserved {} KB at {:s}{:+x}.", Hooks::Arena::Size / 1024, sExeName.c_str(), (intptr_t)Hooks::Arena::Base - (intptr_t)baseModule);
+    }
+    else
+    {
+        spdlog::error("Hook Arena: Failed to reserve memory near {:s}, using default hook allocator.", sExeName.c_str());
+    }
+}
+
+// Runs once per presented frame, from the Present hook.
+void FrameTiming()
+{
+    if (bHighRefreshRate)
+    {
+        FrameRate::Limit();
+    }
+
+    Frame::Tick();
+    if (bThreadPlacement)
+    {
+        Threads::OnFrame();
+    }
+    if (bHighRefreshRate)
+    {
+        fCurrentFrametime = FrameRate::OnFrame();
+    }
+    if (bLiveMetrics)
+    {
+        Metrics::OnFrame();
+    }
+}
+
+// Keeps the published resolution in step with the swapchain, which the game resizes on mode changes.
+void SwapChainResized(UINT width, UINT height)
+{
+    if (width && height)
+    {
+        Metrics::PublishResolution((int)width, (int)height, (float)width / (float)height, fNativeAspect);
+    }
+}
+
+void SwapChain()
+{
+    // Present is the frame boundary for the framerate unlock, thread placement and live metrics.
+    bool bFrameTiming = bHighRefreshRate || bThreadPlacement || bLiveMetrics;
+    if (bLowLatency || bFrameTiming)
+    {
+        // Must be hooked before the game creates its swapchain.
+        Presentation::OnFrame = bFrameTiming ? FrameTiming : nullptr;
+        Presentation::OnResize = bLiveMetrics ? SwapChainResized : nullptr;
+        if (Presentation::Init(bLowLatency, iMaxFrameLatency, bAllowTearing))
+        {
+            spdlog::info("Swapchain: Hooked CreateSwapChain. Low latency: {}, max frame latency: {}, tearing supported: {}", bLowLatency, Presentation::MaxFrameLatency, Presentation::bTearingSupported);
+        }
+        else
+        {
+            spdlog::error("Swapchain: Failed to hook CreateSwapChain.");
+        }
+    }
+}
+
+void ShaderPrewarm()
+{
+    if (bShaderPrewarm)
+    {
+        // Must be hooked before the game creates its device.
+        if (Shaders::Init(sThisModulePath / sShaderManifestFile))
+        {
+            spdlog::info("Shader Prewarm: Hooked D3D11 device creation. Manifest: {}", (sThisModulePath / sShaderManifestFile).string());
+        }
+        else
+        {
+            spdlog::error("Shader Prewarm: Failed to hook D3D11 device creation.");
+        }
+    }
+}
+
+void HookArenaSeal()
+{
+    if (Hooks::Arena::Allocator)
+    {
+        size_t Used = Hooks::Arena::Used();
+        bool bSealed = Hooks::Arena::Seal();
+        spdlog::info("Hook Arena: {} hooks using {} of {} bytes. Sealed read-execute: {}", Hooks::Arena::HookCount, Used, Hooks::Arena::Size, bSealed);
+        if (!Hooks::Arena::Overflows.empty())
+        {
+            spdlog::error("Hook Arena: Ran out of room, {} blocks ({} bytes) were mapped outside the arena and sealed with it.", Hooks::Arena::Overflows.size(), Hooks::Arena::OverflowSize());
+        }
+    }
+}
+
+void LiveMetricsStartup()
+{
+    if (bLiveMetrics)
+    {
+        Metrics::PublishStartup(Frame::Now() - StartupTicks, Memory::PatternScanTicks, Memory::PatternScanCount);
+        Metrics::Start();
+    }
+}
+
 // SetWindowLongA Hook
 SafetyHookInline SetWindowLongA_hook{};
 LONG WINAPI SetWindowLongA_hooked(HWND hWnd, int nIndex, LONG dwNewLong)
@@ -184,24 +396,42 @@ LONG WINAPI SetWindowLongA_hooked(HWND hWnd, int nIndex, LONG dwNewLong)
     // Check if game is in windowed mode and that the class name is correct.
     if (iWindowMode == 0 && bBorderlessMode)
     {
-        // Get window style
-        LONG lStyle = GetWindowLong(hWnd, GWL_STYLE);
-        LONG lExStyle = GetWindowLong(hWnd, GWL_EXSTYLE);
-
-        // Apply borderless style
-        lStyle &= ~(WS_CAPTION | WS_THICKFRAME | WS_MINIMIZE | WS_MAXIMIZE | WS_SYSMENU);
-        lExStyle &= ~(WS_EX_DLGMODALFRAME | WS_EX_CLIENTEDGE | WS_EX_STATICEDGE);
+        // Keep the game's own style writes borderless so they don't undo what was applied.
+        if (nIndex == GWL_STYLE || nIndex == GWL_EXSTYLE)
+        {
+            dwNewLong = WindowState::Borderless(nIndex, dwNewLong);
+            LONG lCurrent = GetWindowLong(hWnd, nIndex);
+            if (dwNewLong == lCurrent)
+            {
+                // Apply counts the style write it finds already in place as skipped.
+                WindowState::Apply(hWnd);
+                return lCurrent;
+            }
+        }
 
-        SetWindowLong(hWnd, GWL_STYLE, lStyle);
-        SetWindowLong(hWnd, GWL_EXSTYLE, lExStyle);
+        LONG lResult = SetWindowLongA_hook.stdcall<LONG>(hWnd, nIndex, dwNewLong);
+        bool bStyleChanged = (nIndex == GWL_STYLE || nIndex == GWL_EXSTYLE) && lResult != dwNewLong;
 
-        // Maximize window and put window on top
-        SetWindowPos(hWnd, HWND_TOP, 0, 0, DesktopDimensions.first, DesktopDimensions.second, NULL);
+        // Apply borderless style and fill the window's monitor, only touching what differs.
+        WindowState::Apply(hWnd, bStyleChanged);
+        return lResult;
     }
 
     return SetWindowLongA_hook.stdcall<LONG>(hWnd, nIndex, dwNewLong);
 }
 
+// SetWindowPos Hook
+SafetyHookInline SetWindowPos_hook{};
+BOOL WINAPI SetWindowPos_hooked(HWND hWnd, HWND hWndInsertAfter, int X, int Y, int cx, int cy, UINT uFlags)
+{
+    if (iWindowMode == 0 && bBorderlessMode)
+    {
+        WindowState::Clamp(hWnd, X, Y, cx, cy, uFlags);
+    }
+
+    return SetWindowPos_hook.stdcall<BOOL>(hWnd, hWndInsertAfter, X, Y, cx, cy, uFlags);
+}
+
 void IntroSkip()
 {
     if (bIntroSkip)
@@ -214,11 +444,7 @@ void IntroSkip()
 
             // Skip intro logos
             static SafetyHookMid IntroSkipMidHook{};
-            IntroSkipMidHook = safetyhook::create_mid(IntroSkipScanResult + 0x7,
-                [](SafetyHookContext& ctx)
-                {
-                    ctx.rdx = 1;
-                });
+            IntroSkipMidHook = Hooks::CreateMid("Intro Skip", IntroSkipScanResult + 0x7, Callbacks::IntroSkip);
         }
         else if (!IntroSkipScanResult)
         {
@@ -236,23 +462,13 @@ void Resolution()
         if (ApplyResolutionScanResult)
         {
             spdlog::info("Custom Resolution: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)ApplyResolutionScanResult - (uintptr_t)baseModule);
-            static SafetyHookMid ApplyResolutionMidHook{};
-            ApplyResolutionMidHook = safetyhook::create_mid(ApplyResolutionScanResult,
-                [](SafetyHookContext& ctx)
+            Callbacks::OnCustomResolution = [](int width, int height)
                 {
-                    if (ctx.r8 && ctx.rdx)
-                    {
-                        // Internal resolution
-                        *reinterpret_cast<short*>(ctx.r8) = (short)iCustomResX;
-                        *reinterpret_cast<short*>(ctx.r8 + 0x2) = (short)iCustomResY;
-
-                        // Window size
-                        *reinterpret_cast<short*>(ctx.rdx) = (short)iCustomResX;
-                        *reinterpret_cast<short*>(ctx.rdx + 0x2) = (short)iCustomResY;
+                    spdlog::info("Custom Resolution: Applied custom resolution: Window: {}x{} | Internal: {}x{}", width, height, width, height);
+                };
 
-                        spdlog::info("Custom Resolution: Applied custom resolution: Window: {}x{} | Internal: {}x{}", iCustomResX, iCustomResY, iCustomResX, iCustomResY);
-                    }
-                });
+            static SafetyHookMid ApplyResolutionMidHook{};
+            ApplyResolutionMidHook = Hooks::CreateMid("Custom Resolution", ApplyResolutionScanResult, Callbacks::CustomResolution, { { offsetof(SafetyHookContext, r8), 0x0, 0x4 }, { offsetof(SafetyHookContext, rdx), 0x0, 0x4 } });
         }
         else if (!ApplyResolutionScanResult)
         {
@@ -268,12 +484,7 @@ void Resolution()
                 spdlog::info("Windowed Mode: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)WindowedModeScanResult - (uintptr_t)baseModule);
 
                 static SafetyHookMid WindowedModeMidHook{};
-                WindowedModeMidHook = safetyhook::create_mid(WindowedModeScanResult + 0x5,
-                    [](SafetyHookContext& ctx)
-                    {
-                        // Grab window mode
-                        iWindowMode = (int)ctx.rax;
-                    });
+                WindowedModeMidHook = Hooks::CreateMid("Windowed Mode", WindowedModeScanResult + 0x5, Callbacks::WindowedMode);
             }
             else if (!WindowedModeScanResult)
             {
@@ -281,7 +492,10 @@ void Resolution()
             }
 
             // Hook SetWindowLongA.
-            SetWindowLongA_hook = safetyhook::create_inline(&SetWindowLongA, reinterpret_cast<void*>(SetWindowLongA_hooked));
+            SetWindowLongA_hook = Hooks::CreateInline(reinterpret_cast<void*>(&SetWindowLongA), reinterpret_cast<void*>(SetWindowLongA_hooked));
+
+            // Hook SetWindowPos.
+            SetWindowPos_hook = Hooks::CreateInline(reinterpret_cast<void*>(&SetWindowPos), reinterpret_cast<void*>(SetWindowPos_hooked));
         }
     }
 }
@@ -297,14 +511,7 @@ void HUD()
             spdlog::info("HUD: HUD Width: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)HUDWidthScanResult - (uintptr_t)baseModule);
 
             static SafetyHookMid HUDWidthMidHook{};
-            HUDWidthMidHook = safetyhook::create_mid(HUDWidthScanResult + 0xB,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm0.f32[0] = (float)iCustomResY * fNativeAspect;
-                    }
-                });
+            HUDWidthMidHook = Hooks::CreateMid("HUD: HUD Width", HUDWidthScanResult + 0xB, Callbacks::HUDWidth);
         }
         else if (!HUDWidthScanResult)
         {
@@ -318,27 +525,7 @@ void HUD()
             spdlog::info("HUD: Menu Backgrounds: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)MenuBackgroundsScanResult - (uintptr_t)baseModule);
 
             static SafetyHookMid MenuBackgroundsMidHook{};
-            MenuBackgroundsMidHook = safetyhook::create_mid(MenuBackgroundsScanResult,
-                [](SafetyHookContext& ctx)
-                {
-                    if (ctx.rdi + 0x80)
-                    {
-                        // Check for 1280x800 background
-                        if (*reinterpret_cast<float*>(ctx.rdi + 0x7C) == 1280.00f && *reinterpret_cast<float*>(ctx.rdi + 0x80) == 800.00f)
-                        {
-                            if (fAspectRatio > fNativeAspect)
-                            {
-                                *reinterpret_cast<float*>(ctx.rdi + 0x7C) = 720.00f * fAspectRatio;
-                                *reinterpret_cast<float*>(ctx.rdi + 0x18) = -(((720.00f * fAspectRatio) - 1280.00f) / 2.00f);
-                            }
-                            else if (fAspectRatio < 1.60f)
-                            {
-                                *reinterpret_cast<float*>(ctx.rdi + 0x80) = 1280.00f / fAspectRatio;
-                                *reinterpret_cast<float*>(ctx.rdi + 0x1C) = -(((1280.00f / fAspectRatio) - 720.00f) / 2.00f);
-                            }
-                        }
-                    }
-                });
+            MenuBackgroundsMidHook = Hooks::CreateMid("HUD: Menu Backgrounds", MenuBackgroundsScanResult, Callbacks::MenuBackgrounds, { { offsetof(SafetyHookContext, rdi), 0x18, 0x6C } });
         }
         else if (!MenuBackgroundsScanResult)
         {
@@ -352,21 +539,7 @@ void HUD()
             spdlog::info("HUD: HUD Scissor: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)HUDScissorScanResult - (uintptr_t)baseModule);
 
             static SafetyHookMid HUDScissorMidHook{};
-            HUDScissorMidHook = safetyhook::create_mid(HUDScissorScanResult - 0x3,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm2.f32[0] = fHUDWidth / 1280.00f;
-                        ctx.xmm8.f32[0] += ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
-                        ctx.xmm9.f32[0] += ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
-                    }
-                    else if (fAspectRatio < 1.60f)
-                    {
-                        ctx.xmm6.f32[0] += ((1280.00f / fAspectRatio) - 720.00f) / 2.00f;
-                        ctx.xmm7.f32[0] += ((1280.00f / fAspectRatio) - 720.00f) / 2.00f;
-                    }
-                });
+            HUDScissorMidHook = Hooks::CreateMid("HUD: HUD Scissor", HUDScissorScanResult - 0x3, Callbacks::HUDScissor);
         }
         else if (!HUDScissorScanResult)
         {
@@ -382,55 +555,20 @@ void HUD()
             spdlog::info("HUD: Minimap Compass: North: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)MinimapCompassScanResult - (uintptr_t)baseModule);
 
             static SafetyHookMid MinimapCompass1MidHook{};
-            MinimapCompass1MidHook = safetyhook::create_mid(MinimapCompassScanResult + 0x36,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm0.f32[0] = fHUDWidth / 1280.00f;
-                    }
-                });
+            MinimapCompass1MidHook = Hooks::CreateMid("HUD: Minimap Compass 1", MinimapCompassScanResult + 0x36, Callbacks::MinimapCompassScale);
 
             static SafetyHookMid MinimapCompass2MidHook{};
-            MinimapCompass2MidHook = safetyhook::create_mid(MinimapCompassScanResult + 0x9B,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm0.f32[0] = fHUDWidth / 1280.00f;
-                    }
-                });
+            MinimapCompass2MidHook = Hooks::CreateMid("HUD: Minimap Compass 2", MinimapCompassScanResult + 0x9B, Callbacks::MinimapCompassScale);
 
             static SafetyHookMid MinimapCompass3MidHook{};
-            MinimapCompass3MidHook = safetyhook::create_mid(MinimapCompassScanResult + 0x10D,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm7.f32[0] = fHUDWidth;
-                    }
-                });
+            MinimapCompass3MidHook = Hooks::CreateMid("HUD: Minimap Compass 3", MinimapCompassScanResult + 0x10D, Callbacks::MinimapCompassWidth);
 
             static SafetyHookMid MinimapCompassNarrowMidHook{};
-            MinimapCompassNarrowMidHook = safetyhook::create_mid(MinimapCompassScanResult,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio < 1.60f)
-                    {
-                        ctx.xmm7.f32[0] = ((1280.00f / fAspectRatio) - 720.00f) / 2.00f;
-                    }
-                });
+            MinimapCompassNarrowMidHook = Hooks::CreateMid("HUD: Minimap Compass Narrow", MinimapCompassScanResult, Callbacks::MinimapCompassNarrow);
 
             // North marker on compass
             static SafetyHookMid MinimapCompassNorthMidHook{};
-            MinimapCompassNorthMidHook = safetyhook::create_mid(MinimapCompassNorthScanResult,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm6.f32[0] = -0.05f * fHUDWidth + 72.00f; // Not sure on how they calculated this, but this formula produces very similar results.
-                    }
-                });
+            MinimapCompassNorthMidHook = Hooks::CreateMid("HUD: Minimap Compass North", MinimapCompassNorthScanResult, Callbacks::MinimapCompassNorth);
         }
         else if (!MinimapCompassScanResult)
         {
@@ -444,39 +582,10 @@ void HUD()
             spdlog::info("HUD: Fades: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)FadesScanResult - (uintptr_t)baseModule);
 
             static SafetyHookMid FadesMidHook{};
-            FadesMidHook = safetyhook::create_mid(FadesScanResult + 0x7,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        float fWidthOffset = ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
-
-                        ctx.xmm1.f32[0] = 0.00f;
-                        ctx.xmm2.f32[0] = 720.00f;
-
-                        if (ctx.rcx + 0x6D0 && ctx.rcx + 6E0)
-                        {
-                            *reinterpret_cast<float*>(ctx.rcx + 0x6D0) = -fWidthOffset;
-                            *reinterpret_cast<float*>(ctx.rcx + 0x6E0) = -fWidthOffset;
-                        }
-                    }
-                });
+            FadesMidHook = Hooks::CreateMid("HUD: Fades", FadesScanResult + 0x7, Callbacks::Fades, { { offsetof(SafetyHookContext, rcx), 0x6D0, 0x14 } });
 
             static SafetyHookMid FadesSizeMidHook{};
-            FadesSizeMidHook = safetyhook::create_mid(FadesScanResult + 0x77, // Big gap but this game ain't getting updates, so who cares?
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        float fWidthOffset = ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
-
-                        if (ctx.rcx + 0x6F0 && ctx.rcx + 0x700)
-                        {
-                            *reinterpret_cast<float*>(ctx.rcx + 0x6F0) = (720.00f * fAspectRatio) - fWidthOffset;
-                            *reinterpret_cast<float*>(ctx.rcx + 0x700) = (720.00f * fAspectRatio) - fWidthOffset;
-                        }
-                    }
-                });
+            FadesSizeMidHook = Hooks::CreateMid("HUD: Fades Size", FadesScanResult + 0x77, Callbacks::FadesSize, { { offsetof(SafetyHookContext, rcx), 0x6F0, 0x14 } }); // Big gap but this game ain't getting updates, so who cares?
         }
         else if (!FadesScanResult)
         {
@@ -490,18 +599,7 @@ void HUD()
             spdlog::info("HUD: Battle Crossfades: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)BattleCrossfadesScanResult - (uintptr_t)baseModule);
 
             static SafetyHookMid BattleCrossfadesMidHook{};
-            BattleCrossfadesMidHook = safetyhook::create_mid(BattleCrossfadesScanResult,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm3.f32[0] *= fAspectMultiplier;
-                    }
-                    else if (fAspectRatio < 1.60f)
-                    {
-                        ctx.xmm3.f32[0] /= fAspectMultiplier;
-                    }
-                });
+            BattleCrossfadesMidHook = Hooks::CreateMid("HUD: Battle Crossfades", BattleCrossfadesScanResult, Callbacks::BattleCrossfades);
         }
         else if (!BattleCrossfadesScanResult)
         {
@@ -516,56 +614,20 @@ void HUD()
 
             // >16:9
             static SafetyHookMid MarkersWidth1MidHook{};
-            MarkersWidth1MidHook = safetyhook::create_mid(MarkersScanResult + 0x3,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm0.f32[0] = fHUDWidth;
-                    }
-                });
+            MarkersWidth1MidHook = Hooks::CreateMid("HUD: Markers Width 1", MarkersScanResult + 0x3, Callbacks::MarkersWidth1);
 
             static SafetyHookMid MarkersWidth2MidHook{};
-            MarkersWidth2MidHook = safetyhook::create_mid(MarkersScanResult + 0x6F,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm1.f32[0] = fHUDWidth;
-                    }
-                });
+            MarkersWidth2MidHook = Hooks::CreateMid("HUD: Markers Width 2", MarkersScanResult + 0x6F, Callbacks::MarkersWidth2);
 
             static SafetyHookMid MarkersOffsetMidHook{};
-            MarkersOffsetMidHook = safetyhook::create_mid(MarkersScanResult + 0x1F,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm0.f32[0] -= ((720.00f * fAspectRatio) - 1280.00f) / 2.00f;
-                    }
-                });
+            MarkersOffsetMidHook = Hooks::CreateMid("HUD: Markers Offset", MarkersScanResult + 0x1F, Callbacks::MarkersOffset);
 
             // <16:9
             static SafetyHookMid MarkersNarrow1MidHook{};
-            MarkersNarrow1MidHook = safetyhook::create_mid(MarkersScanResult + 0x44,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio < 1.60f)
-                    {
-                        ctx.rax = ctx.rcx;
-                    }
-                });
+            MarkersNarrow1MidHook = Hooks::CreateMid("HUD: Markers Narrow 1", MarkersScanResult + 0x44, Callbacks::MarkersNarrow1);
 
             static SafetyHookMid MarkersNarrow2MidHook{};
-            MarkersNarrow2MidHook = safetyhook::create_mid(MarkersScanResult + 0x50,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio < 1.60f)
-                    {
-                        ctx.xmm2.f32[0] += 40.00f;
-                        ctx.xmm2.f32[0] -= ((1280.00f / fAspectRatio) - 720.00f) / 2.00f; // 40.00f at 1920x1200 for example
-                    }
-                });
+            MarkersNarrow2MidHook = Hooks::CreateMid("HUD: Markers Narrow 2", MarkersScanResult + 0x50, Callbacks::MarkersNarrow2);
         }
         else if (!MarkersScanResult)
         {
@@ -582,86 +644,57 @@ void HUD()
 
             // Left edge
             static SafetyHookMid BattleMarkersLeft1MidHook{};
-            BattleMarkersLeft1MidHook = safetyhook::create_mid(BattleMarkersScanResult,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        // Set left side to 80 - the hud width offset.
-                        ctx.xmm3.f32[0] = 80.00f - (((720.00f * fAspectRatio) - 1280.00f) / 2.00f); // -80
-                    }
-                });
+            BattleMarkersLeft1MidHook = Hooks::CreateMid("HUD: Battle Markers Left 1", BattleMarkersScanResult, Callbacks::BattleMarkersLeft1);
 
             static SafetyHookMid BattleMarkersLeft2MidHook{};
-            BattleMarkersLeft2MidHook = safetyhook::create_mid(BattleMarkersScanResult + 0xBB,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        // Set left side to 80 - the hud width offset.
-                        ctx.xmm1.f32[0] = 80.00f - (((720.00f * fAspectRatio) - 1280.00f) / 2.00f); // 80
-                    }
-                });
+            BattleMarkersLeft2MidHook = Hooks::CreateMid("HUD: Battle Markers Left 2", BattleMarkersScanResult + 0xBB, Callbacks::BattleMarkersLeft2);
 
             // Need to grab the address for the right edge value as it's used in a comiss. Luckily it isn't used anywhere else.
-            BattleMarkerRightValue = Memory::GetAbsolute((uintptr_t)BattleMarkersScanResult + 0xE);
+            Callbacks::BattleMarkerRightValue = reinterpret_cast<float*>(Memory::GetAbsolute((uintptr_t)BattleMarkersScanResult + 0xE));
 
             // Need to grab address for the marker flip at the right edge of the screen.
-            BattleMarkerFlipValue = Memory::GetAbsolute((uintptr_t)BattleMarkersEdgeFlipScanResult + 0x6);
+            Callbacks::BattleMarkerFlipValue = reinterpret_cast<float*>(Memory::GetAbsolute((uintptr_t)BattleMarkersEdgeFlipScanResult + 0x6));
+
+            // The right edge callback writes both every call, so leave them writable instead of reprotecting each time.
+            DWORD oldProtect;
+            VirtualProtect(Callbacks::BattleMarkerRightValue, sizeof(float), PAGE_EXECUTE_WRITECOPY, &oldProtect);
+            VirtualProtect(Callbacks::BattleMarkerFlipValue, sizeof(float), PAGE_EXECUTE_WRITECOPY, &oldProtect);
 
             // Right edge
             static SafetyHookMid BattleMarkersRightMidHook{};
-            BattleMarkersRightMidHook = safetyhook::create_mid(BattleMarkersScanResult + 0xCD,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        // Need to leave the 80px margin
-                        if (BattleMarkerRightValue && BattleMarkerFlipValue)
-                        {
-                            Memory::Write(BattleMarkerRightValue, 1280.00f + (((720.00f * fAspectRatio) - 1280.00f) / 2.00f));
-                            Memory::Write(BattleMarkerFlipValue, 900.00f + (((720.00f * fAspectRatio) - 1280.00f) / 2.00f));
-                        }
-                        ctx.xmm0.f32[0] = 1200.00f + (((720.00f * fAspectRatio) - 1280.00f) / 2.00f);
-                    }
-                });
+            BattleMarkersRightMidHook = Hooks::CreateMid("HUD: Battle Markers Right", BattleMarkersScanResult + 0xCD, Callbacks::BattleMarkersRight);
         }
         else if (!BattleMarkersScanResult || !BattleMarkersEdgeFlipScanResult)
         {
             spdlog::error("HUD: Battle Markers Boundary: Pattern scan failed.");
         }
+    }
+}
 
+void Movies()
+{
+    // Movie playback also tells the framerate unlock when to fall back to 60 FPS.
+    if (bFixHUD || bHighRefreshRate)
+    {
         // Movies
         uint8_t* MovieTextureScanResult = Memory::PatternScan(baseModule, "F3 0F ?? ?? ?? F3 0F ?? ?? F3 41 ?? ?? ?? 44 0F ?? ?? ?? ?? 0F 28 ??");
         if (MovieTextureScanResult)
         {
             spdlog::info("HUD: Movie: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)MovieTextureScanResult - (uintptr_t)baseModule);
 
+            if (bHighRefreshRate)
+            {
+                Callbacks::OnMovie = FrameRate::OnMovie;
+            }
+
             static SafetyHookMid MovieTextureMidHook{};
-            MovieTextureMidHook = safetyhook::create_mid(MovieTextureScanResult + 0x5,
-                [](SafetyHookContext& ctx)
-                {
-                    if (ctx.rbx)
-                    {
-                        if (fAspectRatio > fNativeAspect)
-                        {
-                            *reinterpret_cast<float*>(ctx.rbx) = -1.00f / fAspectMultiplier;
-                            *reinterpret_cast<float*>(ctx.rbx + 0x1C) = -1.00f / fAspectMultiplier;
-                            *reinterpret_cast<float*>(ctx.rbx + 0x38) = 1.00f / fAspectMultiplier;
-                            *reinterpret_cast<float*>(ctx.rbx + 0x54) = 1.00f / fAspectMultiplier;
-                        }
-                    }
-                });
-
-            static SafetyHookMid MovieTextureNarrowMidHook{};
-            MovieTextureNarrowMidHook = safetyhook::create_mid(MovieTextureScanResult - 0x87,
-                [](SafetyHookContext& ctx)
-                {
-                    if (fAspectRatio < 1.60f)
-                    {
-                        ctx.xmm6.f32[0] = fAspectMultiplier;
-                    }
-                });
+            MovieTextureMidHook = Hooks::CreateMid("HUD: Movie", MovieTextureScanResult + 0x5, Callbacks::Movie, { { offsetof(SafetyHookContext, rbx), 0x0, 0x58 } });
+
+            if (bFixHUD)
+            {
+                static SafetyHookMid MovieTextureNarrowMidHook{};
+                MovieTextureNarrowMidHook = Hooks::CreateMid("HUD: Movie Narrow", MovieTextureScanResult - 0x87, Callbacks::MovieNarrow);
+            }
         }
         else if (!MovieTextureScanResult)
         {
@@ -681,14 +714,7 @@ void FOV()
             spdlog::info("FOV: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)FOVScanResult - (uintptr_t)baseModule);
 
             static SafetyHookMid FOVMidHook{};
-            FOVMidHook = safetyhook::create_mid(FOVScanResult,
-                [](SafetyHookContext& ctx)
-                {  
-                    if (fAspectRatio > fNativeAspect)
-                    {
-                        ctx.xmm2.f32[0] *= 1.00f / fAspectMultiplier;
-                    }
-                });
+            FOVMidHook = Hooks::CreateMid("FOV", FOVScanResult, Callbacks::FOV);
         }
         else if (!FOVScanResult)
         {
@@ -726,14 +752,7 @@ void Graphics()
             spdlog::info("ShadowDistance: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)ShadowDistanceScanResult - (uintptr_t)baseModule);
 
             static SafetyHookMid ShadowDistanceMidHook{};
-            ShadowDistanceMidHook = safetyhook::create_mid(ShadowDistanceScanResult,
-                [](SafetyHookContext& ctx)
-                {
-                    if (ctx.rbx + 0x120)
-                    {
-                        *reinterpret_cast<float*>(ctx.rbx + 0x120) = 24000.00f; // 4x Shadow draw distance. Default = 6000. 
-                    }
-                });
+            ShadowDistanceMidHook = Hooks::CreateMid("Shadow Distance", ShadowDistanceScanResult, Callbacks::ShadowDistance, { { offsetof(SafetyHookContext, rbx), 0x120, 0x4 } });
         }
         else if (!ShadowDistanceScanResult)
         {
@@ -742,15 +761,259 @@ void Graphics()
     }   
 }
 
+void HighRefreshRate()
+{
+    if (bHighRefreshRate)
+    {
+        // Frame timestep
+        uint8_t* TimestepScanResult = Memory::PatternScan(baseModule, "F3 0F 10 ?? ?? ?? ?? ?? F3 0F 59 ?? ?? ?? ?? ?? F3 0F 58 ?? ?? ?? ?? ?? F3 0F 11 ?? ?? ?? ?? ?? 48 8B ?? E8");
+        uint8_t* TimestepHookAddress = TimestepScanResult ? FrameRate::AddSite(0, "Timestep", baseModule, TimestepScanResult, true) : nullptr;
+        if (TimestepHookAddress)
+        {
+            spdlog::info("High Refresh Rate: Timestep: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)TimestepScanResult - (uintptr_t)baseModule);
+
+            static SafetyHookMid TimestepMidHook{};
+            TimestepMidHook = Hooks::CreateMid("High Refresh Rate: Timestep", TimestepHookAddress, Callbacks::ScaleStep<0>);
+        }
+        else
+        {
+            spdlog::error("High Refresh Rate: Timestep: Pattern scan failed.");
+            return;
+        }
+
+        // UI animation step
+        uint8_t* UIAnimationScanResult = Memory::PatternScan(baseModule, "F3 0F 10 ?? ?? ?? ?? ?? F3 0F 58 ?? ?? ?? F3 0F 11 ?? ?? ?? 0F 2F ?? ?? ?? ?? ?? 72");
+        uint8_t* UIAnimationHookAddress = UIAnimationScanResult ? FrameRate::AddSite(1, "UI Animation", baseModule, UIAnimationScanResult, false) : nullptr;
+        if (UIAnimationHookAddress)
+        {
+            spdlog::info("High Refresh Rate: UI Animation: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)UIAnimationScanResult - (uintptr_t)baseModule);
+
+            static SafetyHookMid UIAnimationMidHook{};
+            UIAnimationMidHook = Hooks::CreateMid("High Refresh Rate: UI Animation", UIAnimationHookAddress, Callbacks::ScaleStep<1>);
+        }
+        else
+        {
+            spdlog::error("High Refresh Rate: UI Animation: Pattern scan failed.");
+        }
+
+        // Fade step
+        uint8_t* FadeStepScanResult = Memory::PatternScan(baseModule, "F3 0F 10 ?? ?? ?? ?? ?? F3 0F 5C ?? ?? ?? 0F 57 ?? 0F 2F ?? F3 0F 11 ?? ?? ??");
+        uint8_t* FadeStepHookAddress = FadeStepScanResult ? FrameRate::AddSite(2, "Fade Step", baseModule, FadeStepScanResult, false) : nullptr;
+        if (FadeStepHookAddress)
+        {
+            spdlog::info("High Refresh Rate: Fade Step: Address is {:s}+{:x}", sExeName.c_str(), (uintptr_t)FadeStepScanResult - (uintptr_t)baseModule);
+
+            static SafetyHookMid FadeStepMidHook{};
+            FadeStepMidHook = Hooks::CreateMid("High Refresh Rate: Fade Step", FadeStepHookAddress, Callbacks::ScaleStep<2>);
+        }
+        else
+        {
+            spdlog::error("High Refresh Rate: Fade Step: Pattern scan failed.");
+        }
+
+        FrameRate::MinFrametime = iFramerateCap > 0 ? 1.00 / std::max(iFramerateCap, 30) : 0.00;
+        spdlog::info("High Refresh Rate: Framerate cap: {}", iFramerateCap > 0 ? std::to_string(std::max(iFramerateCap, 30)) : "Uncapped");
+
+        // Sleep needs to be hooked so any frame limiter sleeps on the render thread can be dropped.
+        // With High Resolution Timers that is already done, otherwise only that sleep is touched.
+        if (!bHighResTimers)
+        {
+            Timing::Sleep_original = reinterpret_cast<Timing::Sleep_t>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "Sleep"));
+            if (Timing::Sleep_original && Memory::HookIAT(baseModule, "kernel32.dll", reinterpret_cast<void*>(Timing::Sleep_original), reinterpret_cast<void*>(Timing::SkipSleep_hooked)))
+            {
+                spdlog::info("High Refresh Rate: Hooked Sleep.");
+            }
+            else
+            {
+                spdlog::error("High Refresh Rate: Failed to hook Sleep.");
+            }
+        }
+    }
+}
+
+void ThreadPlacement()
+{
+    if (bThreadPlacement)
+    {
+        Threads::RenderMode = (Threads::PlacementMode)std::clamp(iThreadPlacementMode, 0, 2);
+        Threads::iRenderPriority = std::clamp(iRenderThreadPriority, -2, 2);
+        Threads::DetectTopology();
+
+        // Main thread is the one that started at the exe entry point.
+        auto dosHeader = (PIMAGE_DOS_HEADER)baseModule;
+        auto ntHeaders = (PIMAGE_NT_HEADERS)((uint8_t*)baseModule + dosHeader->e_lfanew);
+        uintptr_t EntryPoint = (uintptr_t)baseModule + ntHeaders->OptionalHeader.AddressOfEntryPoint;
+
+        DWORD MainThreadId = Threads::FindByStartAddress(EntryPoint);
+        HANDLE MainThread = MainThreadId ? OpenThread(THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION, FALSE, MainThreadId) : NULL;
+        if (MainThread)
+        {
+            spdlog::info("Thread Placement: Main thread is {} (start address {:s}+{:x}).", MainThreadId, sExeName.c_str(), EntryPoint - (uintptr_t)baseModule);
+            Threads::Place(MainThread, "Main thread", Threads::RenderMode, std::clamp(iMainThreadPriority, -2, 2));
+            CloseHandle(MainThread);
+        }
+        else
+        {
+            spdlog::error("Thread Placement: Failed to find main thread.");
+        }
+
+        // The render thread is taken to be the one that calls Present, and is placed from there (see SwapChain) once it has run for a while.
+    }
+}
+
+void HighResTimers()
+{
+    if (bHighResTimers)
+    {
+        Timing::Init(std::clamp(iTimerSpinMicroseconds, 0, 2000));
+
+        // Sleep
+        if (Timing::Sleep_original && Memory::HookIAT(baseModule, "kernel32.dll", reinterpret_cast<void*>(Timing::Sleep_original), reinterpret_cast<void*>(Timing::Sleep_hooked)))
+        {
+            spdlog::info("High Resolution Timers: Hooked Sleep.");
+        }
+        else
+        {
+            spdlog::error("High Resolution Timers: Failed to hook Sleep.");
+        }
+
+        // timeGetTime
+        if (Timing::timeGetTime_original && Memory::HookIAT(baseModule, "winmm.dll", reinterpret_cast<void*>(Timing::timeGetTime_original), reinterpret_cast<void*>(Timing::timeGetTime_hooked)))
+        {
+            spdlog::info("High Resolution Timers: Hooked timeGetTime.");
+        }
+        else
+        {
+            spdlog::error("High Resolution Timers: Failed to hook timeGetTime.");
+        }
+
+        // GetTickCount
+        if (Timing::GetTickCount_original && Memory::HookIAT(baseModule, "kernel32.dll", reinterpret_cast<void*>(Timing::GetTickCount_original), reinterpret_cast<void*>(Timing::GetTickCount_hooked)))
+        {
+            spdlog::info("High Resolution Timers: Hooked GetTickCount.");
+        }
+        else
+        {
+            spdlog::error("High Resolution Timers: Failed to hook GetTickCount.");
+        }
+
+        std::thread(Timing::Calibrate).detach();
+    }
+}
+
+void FileIO()
+{
+    if (bIOCache)
+    {
+        IOCache::Init(sExePath, sThisModulePath / sIOManifestFile, sThisModulePath / sIOTraceFile, std::max(iIOCacheSizeMB, 0), bIOTrace);
+
+        // Hook file APIs
+        bool bCreateFileW = IOCache::CreateFileW_original && Memory::HookIAT(baseModule, "kernel32.dll", reinterpret_cast<void*>(IOCache::CreateFileW_original), reinterpret_cast<void*>(IOCache::CreateFileW_hooked));
+        bool bCreateFileA = IOCache::CreateFileA_original && Memory::HookIAT(baseModule, "kernel32.dll", reinterpret_cast<void*>(IOCache::CreateFileA_original), reinterpret_cast<void*>(IOCache::CreateFileA_hooked));
+        if (bCreateFileW || bCreateFileA)
+        {
+            spdlog::info("IO Cache: Hooked CreateFileW: {}, CreateFileA: {}", bCreateFileW, bCreateFileA);
+        }
+        else
+        {
+            spdlog::error("IO Cache: Failed to hook CreateFile.");
+            return;
+        }
+
+        if (IOCache::ReadFile_original && Memory::HookIAT(baseModule, "kernel32.dll", reinterpret_cast<void*>(IOCache::ReadFile_original), reinterpret_cast<void*>(IOCache::ReadFile_hooked)))
+        {
+            spdlog::info("IO Cache: Hooked ReadFile.");
+        }
+        else
+        {
+            spdlog::error("IO Cache: Failed to hook ReadFile.");
+        }
+
+        if (IOCache::CloseHandle_original && Memory::HookIAT(baseModule, "kernel32.dll", reinterpret_cast<void*>(IOCache::CloseHandle_original), reinterpret_cast<void*>(IOCache::CloseHandle_hooked)))
+        {
+            spdlog::info("IO Cache: Hooked CloseHandle.");
+        }
+        else
+        {
+            spdlog::error("IO Cache: Failed to hook CloseHandle.");
+        }
+
+        if (bIOTrace)
+        {
+            spdlog::info("IO Cache: Writing I/O trace to {}", (sThisModulePath / sIOTraceFile).string());
+        }
+    }
+}
+
+void PooledHeap()
+{
+    if (bPooledHeap)
+    {
+        if (!Pool::Init(std::max(iPooledHeapReserveMB, 64)))
+        {
+            spdlog::error("Pooled Heap: Failed to reserve {}MB.", iPooledHeapReserveMB);
+            return;
+        }
+
+        // Frees, sizes and reallocs go in first, for every caller, so a pool pointer never reaches an original free.
+        if (!Pool::HookReleaseEverywhere())
+        {
+            spdlog::error("Pooled Heap: Could not hook HeapFree/HeapSize/HeapReAlloc, pool memory could reach the real heap. Pool disabled.");
+            return;
+        }
+        spdlog::info("Pooled Heap: Hooked HeapFree/HeapSize/HeapReAlloc.");
+
+        if (Memory::HookIAT(baseModule, "kernel32.dll", reinterpret_cast<void*>(Pool::HeapAlloc_original), reinterpret_cast<void*>(Pool::HeapAlloc_hooked)))
+        {
+            spdlog::info("Pooled Heap: Hooked HeapAlloc.");
+        }
+        else
+        {
+            spdlog::info("Pooled Heap: HeapAlloc is not imported, left alone.");
+        }
+
+        // Dynamically linked CRT.
+        if (Pool::malloc_original && Pool::free_original && Pool::realloc_original && Pool::calloc_original && Pool::msize_original)
+        {
+            for (const char* crt : { "api-ms-win-crt-heap-l1-1-0.dll", "ucrtbase.dll" })
+            {
+                bool bFree = Memory::HookIAT(baseModule, crt, reinterpret_cast<void*>(Pool::free_original), reinterpret_cast<void*>(Pool::free_hooked));
+                Memory::HookIAT(baseModule, crt, reinterpret_cast<void*>(Pool::msize_original), reinterpret_cast<void*>(Pool::msize_hooked));
+                bool bRealloc = Memory::HookIAT(baseModule, crt, reinterpret_cast<void*>(Pool::realloc_original), reinterpret_cast<void*>(Pool::realloc_hooked));
+                if (bFree && bRealloc)
+                {
+                    bool bMalloc = Memory::HookIAT(baseModule, crt, reinterpret_cast<void*>(Pool::malloc_original), reinterpret_cast<void*>(Pool::malloc_hooked));
+                    bool bCalloc = Memory::HookIAT(baseModule, crt, reinterpret_cast<void*>(Pool::calloc_original), reinterpret_cast<void*>(Pool::calloc_hooked));
+                    spdlog::info("Pooled Heap: Hooked {} (malloc: {}, calloc: {}).", crt, bMalloc, bCalloc);
+                }
+            }
+        }
+    }
+}
+
 DWORD __stdcall Main(void*)
 {
+    StartupTicks = Frame::Now();
     Logging();
     ReadConfig();
+    LiveMetrics();
+    HookTrace();
+    HookArena();
+    SwapChain();
+    ShaderPrewarm();
+    ThreadPlacement();
+    HighResTimers();
+    FileIO();
+    PooledHeap();
     IntroSkip();
     Resolution();
     HUD();
+    Movies();
+    HighRefreshRate();
     FOV();
     Graphics();
+    HookArenaSeal();
+    LiveMetricsStartup();
     return true; //end thread
 }
 
@@ -769,12 +1032,37 @@ BOOL APIENTRY DllMain(HMODULE hModule,
         {
             CloseHandle(mainHandle);
         }
+        break;
     }
     case DLL_THREAD_ATTACH:
     case DLL_THREAD_DETACH:
+        break;
     case DLL_PROCESS_DETACH:
+    {
+        Hooks::Trace::Close();
+        if (bHighResTimers)
+        {
+            Timing::GameSleeps.Log("Game");
+        }
+        if (bIOCache)
+        {
+            IOCache::Shutdown();
+        }
+        if (bPooledHeap)
+        {
+            Pool::Report();
+        }
+        if (bShaderPrewarm)
+        {
+            Shaders::Shutdown();
+        }
+        if (bBorderlessMode)
+        {
+            WindowState::Report();
+        }
         break;
     }
+    }
     return TRUE;
 }
 
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "stdafx.h"
+
+namespace Frame
+{
+    constexpr size_t HistorySize = 256;
+
+    // Frame times in milliseconds, indexed by FrameCount % HistorySize.
+    std::array<float, HistorySize> History{};
+    std::atomic<uint64_t> FrameCount = 0;
+    double LastFrametime = 0.0; // Seconds
+
+    LARGE_INTEGER Frequency{};
+    int64_t LastTick = 0;
+
+    int64_t Now()
+    {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return now.QuadPart;
+    }
+
+    double ToSeconds(int64_t ticks)
+    {
+        if (!Frequency.QuadPart)
+        {
+            QueryPerformanceFrequency(&Frequency);
+        }
+        return (double)ticks / (double)Frequency.QuadPart;
+    }
+
+    // Running mean and variance of frame times over a measurement window (Welford's algorithm).
+    struct Window
+    {
+        uint64_t count = 0;
+        double mean = 0.0;
+        double m2 = 0.0;
+
+        void Add(double ms)
+        {
+            count++;
+            double delta = ms - mean;
+            mean += delta / count;
+            m2 += delta * (ms - mean);
+        }
+
+        double StdDev() const { return count > 1 ? sqrt(m2 / (count - 1)) : 0.0; }
+    };
+
+    // Called once per presented frame, from the Present hook.
+    void Tick()
+    {
+        int64_t now = Now();
+        if (LastTick)
+        {
+            double delta = ToSeconds(now - LastTick);
+            LastFrametime = delta;
+            History[FrameCount % HistorySize] = (float)(delta * 1000.0);
+            FrameCount++;
+        }
+        LastTick = now;
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "stdafx.h"
+#include "callbacks.hpp"
+#include "frame.hpp"
+#include "timing.hpp"
+#include <spdlog/spdlog.h>
+
+namespace FrameRate
+{
+    constexpr float DefaultTimestep = 1.00f / 60.00f;
+    constexpr float MaxTimestep = 1.00f / 30.00f; // Don't let hitches turn in to huge simulation steps.
+    constexpr double MovieTimeout = 0.25;
+
+    double MinFrametime = 0.0;
+    int64_t LastMovieTick = 0;
+    bool bFallback = false;
+
+    bool IsTimestep(float value)
+    {
+        return fabsf(value - DefaultTimestep) < 0.000001f;
+    }
+
+    // Decodes movss xmmN, [rip+disp32] = F3 (REX) 0F 10 modrm disp32.
+    // Returns the instruction length, or 0 if address doesn't hold one that reads from inside the module.
+    size_t DecodeLoad(HMODULE module, uint8_t* address, int& xmm, float*& constant)
+    {
+        size_t i = 1;
+        uint8_t rex = 0;
+        if (address[0] != 0xF3)
+        {
+            return 0;
+        }
+        if ((address[i] & 0xF0) == 0x40)
+        {
+            rex = address[i++];
+        }
+        if (address[i] != 0x0F || address[i + 1] != 0x10 || (address[i + 2] & 0xC7) != 0x05)
+        {
+            return 0;
+        }
+
+        auto base = reinterpret_cast<uint8_t*>(module);
+        auto ntHeaders = (PIMAGE_NT_HEADERS)(base + ((PIMAGE_DOS_HEADER)module)->e_lfanew);
+        size_t length = i + 7;
+        uintptr_t target = (uintptr_t)address + length + *reinterpret_cast<int32_t*>(&address[i + 3]);
+        if (target < (uintptr_t)base || target + sizeof(float) > (uintptr_t)base + ntHeaders->OptionalHeader.SizeOfImage)
+        {
+            return 0;
+        }
+
+        xmm = ((address[i + 2] >> 3) & 7) | (rex & 0x4 ? 8 : 0);
+        constant = reinterpret_cast<float*>(target);
+        return length;
+    }
+
+    // Checks a load of a per-frame step the game assumes is one 60 FPS frame long, and records it as Callbacks::Steps[index]
+    // for Callbacks::ScaleStep<index> to rescale. Returns where to place that mid hook, or nullptr.
+    // The main loop's step must be exactly 1/60, other steps only need to look like a per-frame increment.
+    uint8_t* AddSite(size_t index, const char* name, HMODULE module, uint8_t* address, bool bTimestep)
+    {
+        int xmm = 0;
+        float* constant = nullptr;
+        size_t length = DecodeLoad(module, address, xmm, constant);
+        if (!length)
+        {
+            spdlog::error("High Refresh Rate: {}: Unexpected instruction at exe+{:x}.", name, (uintptr_t)address - (uintptr_t)module);
+            return nullptr;
+        }
+
+        float step = *constant;
+        if (bTimestep ? !IsTimestep(step) : !(step > 0.0f && step <= 1.0f))
+        {
+            spdlog::error("High Refresh Rate: {}: Unexpected step {} at exe+{:x}.", name, step, (uintptr_t)constant - (uintptr_t)module);
+            return nullptr;
+        }
+
+        Callbacks::Steps[index] = { xmm, step };
+        spdlog::info("High Refresh Rate: {}: Step {} loaded in to xmm{}.", name, step, xmm);
+        return address + length;
+    }
+
+    // Called from a hook that plays movies. The game's movie playback is tied to 60 FPS.
+    void OnMovie()
+    {
+        LastMovieTick = Frame::Now();
+    }
+
+    bool InFallback()
+    {
+        return LastMovieTick && Frame::ToSeconds(Frame::Now() - LastMovieTick) < MovieTimeout;
+    }
+
+    // Called before Frame::Tick. Holds the frame until the cap (or 60 FPS during fallback) has elapsed.
+    void Limit()
+    {
+        double minFrametime = bFallback ? DefaultTimestep : MinFrametime;
+        if (!minFrametime || !Frame::LastTick)
+        {
+            return;
+        }
+
+        int64_t target = Frame::LastTick + (int64_t)(minFrametime * Frame::Frequency.QuadPart);
+        if (Frame::Now() < target)
+        {
+            Timing::WaitUntil(target);
+        }
+    }
+
+    // Called once per frame from Present. Returns the timestep the game should simulate this frame.
+    float OnFrame()
+    {
+        // Drop the game's own limiter sleeps on this thread.
+        Timing::SkipSleepThreadId = GetCurrentThreadId();
+
+        bool fallback = InFallback();
+        if (fallback != bFallback)
+        {
+            bFallback = fallback;
+            spdlog::info("High Refresh Rate: {} 60 FPS fallback.", bFallback ? "Entering" : "Leaving");
+        }
+
+        return bFallback ? DefaultTimestep : std::clamp((float)Frame::LastFrametime, (float)MinFrametime, MaxTimestep);
+    }
+}
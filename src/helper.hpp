@@ -35,10 +35,28 @@ namespace Memory
         return ntHeaders->FileHeader.TimeDateStamp;
     }
 
+    // Total time spent in PatternScan, in QPC ticks.
+    uint64_t PatternScanCount = 0;
+    int64_t PatternScanTicks = 0;
+
     // CSGOSimple's pattern scan
     // https://github.com/OneshotGH/CSGOSimple-master/blob/master/CSGOSimple/helpers/utils.cpp
     std::uint8_t* PatternScan(void* module, const char* signature)
     {
+        LARGE_INTEGER scanStart;
+        QueryPerformanceCounter(&scanStart);
+        struct ScanTimer
+        {
+            LARGE_INTEGER& start;
+            ~ScanTimer()
+            {
+                LARGE_INTEGER end;
+                QueryPerformanceCounter(&end);
+                PatternScanCount++;
+                PatternScanTicks += end.QuadPart - start.QuadPart;
+            }
+        } scanTimer{ scanStart };
+
         static auto pattern_to_byte = [](const char* pattern) {
             auto bytes = std::vector<int>{};
             auto start = const_cast<char*>(pattern);
@@ -0,0 +1,470 @@
+#pragma once
+
+#include "stdafx.h"
+#include "callbacks.hpp"
+#include "trace_format.hpp"
+#include <safetyhook.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Hooks
+{
+    // Memory range a hook callback reads or writes, relative to one of the context registers.
+    // e.g. { offsetof(SafetyHookContext, rdi), 0x7C, 0x8 } covers [rdi + 0x7C, rdi + 0x84).
+    struct Probe
+    {
+        uint16_t reg;
+        int32_t offset;
+        uint16_t size;
+    };
+
+    struct Entry
+    {
+        const char* name = nullptr;
+        safetyhook::MidHookFn callback = nullptr;
+        std::vector<Probe> probes;
+    };
+
+    // Fixed number of thunks, one per traced/counted hook. The game only has ~25 mid hooks.
+    constexpr size_t MaxHooks = 64;
+    std::array<Entry, MaxHooks> Entries;
+    std::array<std::atomic<uint64_t>, MaxHooks> Calls{};
+    size_t EntryCount = 0;
+
+    // Route hooks through the thunks to count calls even when not tracing.
+    bool bCountCalls = false;
+
+    // Records every call of a traced hook to a file tools/replay can run the callbacks against, see trace_format.hpp.
+    namespace Trace
+    {
+        constexpr size_t FlushSize = 1024 * 1024;
+
+        std::atomic<bool> bEnabled = false;
+        uint64_t iMaxRecords = 0;
+        uint64_t iRecordCount = 0;
+        FILE* File = nullptr;
+        std::vector<uint8_t> Buffer;
+        std::mutex Mutex;
+        Callbacks::Inputs LastInputs{};
+        bool bHaveInputs = false;
+
+        template<typename T>
+        void Put(const T& value)
+        {
+            auto bytes = reinterpret_cast<const uint8_t*>(&value);
+            Buffer.insert(Buffer.end(), bytes, bytes + sizeof(T));
+        }
+
+        void PutBytes(const void* data, size_t size)
+        {
+            auto bytes = reinterpret_cast<const uint8_t*>(data);
+            Buffer.insert(Buffer.end(), bytes, bytes + size);
+        }
+
+        void Flush()
+        {
+            if (File && !Buffer.empty())
+            {
+                fwrite(Buffer.data(), 1, Buffer.size(), File);
+                fflush(File);
+            }
+            Buffer.clear();
+        }
+
+        // Callbacks only dereference game pointers conditionally, so the trace has to survive bad ones.
+        bool SafeCopy(void* dest, const void* src, size_t size)
+        {
+            __try
+            {
+                memcpy(dest, src, size);
+                return true;
+            }
+            __except (EXCEPTION_EXECUTE_HANDLER)
+            {
+                return false;
+            }
+        }
+
+        void CaptureProbes(const Entry& entry, const SafetyHookContext& ctx, std::vector<uint8_t>& out)
+        {
+            out.clear();
+            for (const auto& probe : entry.probes)
+            {
+                auto base = *reinterpret_cast<const uintptr_t*>(reinterpret_cast<const uint8_t*>(&ctx) + probe.reg);
+                size_t pos = out.size();
+                out.resize(pos + 1 + probe.size);
+                out[pos] = base && SafeCopy(&out[pos + 1], reinterpret_cast<const void*>(base + probe.offset), probe.size);
+            }
+        }
+
+        void WriteHook(uint16_t id, const Entry& entry)
+        {
+            std::scoped_lock lock{ Mutex };
+            Put(TraceFormat::RecordHook);
+            Put(id);
+            Put((uint16_t)strlen(entry.name));
+            PutBytes(entry.name, strlen(entry.name));
+            Put((uint16_t)entry.probes.size());
+            for (const auto& probe : entry.probes)
+            {
+                Put(probe.reg);
+                Put(probe.offset);
+                Put(probe.size);
+            }
+        }
+
+        void WriteCall(uint16_t id, const Callbacks::Inputs& inputs, const SafetyHookContext& before, const std::vector<uint8_t>& probesBefore,
+            const SafetyHookContext& after, const std::vector<uint8_t>& probesAfter, int64_t start, uint32_t duration)
+        {
+            constexpr size_t ContextWords = sizeof(SafetyHookContext) / sizeof(uint64_t);
+            static_assert(ContextWords <= 64, "Context no longer fits the change mask.");
+
+            std::scoped_lock lock{ Mutex };
+            if (!File || iRecordCount >= iMaxRecords)
+            {
+                return;
+            }
+
+            auto wordsBefore = reinterpret_cast<const uint64_t*>(&before);
+            auto wordsAfter = reinterpret_cast<const uint64_t*>(&after);
+            uint64_t changed = 0;
+            for (size_t i = 0; i < ContextWords; i++)
+            {
+                if (wordsBefore[i] != wordsAfter[i])
+                {
+                    changed |= 1ull << i;
+                }
+            }
+
+            if (!bHaveInputs || memcmp(&inputs, &LastInputs, sizeof(inputs)) != 0)
+            {
+                Put(TraceFormat::RecordInputs);
+                Put((uint16_t)sizeof(inputs));
+                Put(inputs);
+                LastInputs = inputs;
+                bHaveInputs = true;
+            }
+
+            Put(TraceFormat::RecordCall);
+            Put(id);
+            Put((uint32_t)GetCurrentThreadId());
+            Put(start);
+            Put(duration);
+            Put(before);
+            PutBytes(probesBefore.data(), probesBefore.size());
+            Put(changed);
+            for (size_t i = 0; i < ContextWords; i++)
+            {
+                if (changed & (1ull << i))
+                {
+                    Put(wordsAfter[i]);
+                }
+            }
+            PutBytes(probesAfter.data(), probesAfter.size());
+
+            // Once full, hooks go back to calling their callback directly instead of capturing for nothing.
+            if (++iRecordCount == iMaxRecords)
+            {
+                bEnabled = false;
+                spdlog::info("Hook Trace: Reached {} records, stopping trace.", iMaxRecords);
+            }
+
+            if (Buffer.size() >= FlushSize || iRecordCount == iMaxRecords)
+            {
+                Flush();
+            }
+        }
+
+        bool Open(const std::filesystem::path& path, uint64_t maxRecords)
+        {
+            if (_wfopen_s(&File, path.c_str(), L"wb") != 0 || !File)
+            {
+                File = nullptr;
+                return false;
+            }
+
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+
+            iMaxRecords = maxRecords;
+            Buffer.reserve(FlushSize * 2);
+            PutBytes(TraceFormat::Magic, sizeof(TraceFormat::Magic));
+            Put(TraceFormat::Version);
+            Put((uint16_t)sizeof(SafetyHookContext));
+            Put((uint64_t)frequency.QuadPart);
+            bEnabled = true;
+            return true;
+        }
+
+        // Called at process detach, a thread that died mid-record may still own Mutex.
+        void Close()
+        {
+            bEnabled = false;
+            std::unique_lock lock{ Mutex, std::try_to_lock };
+            if (lock && File)
+            {
+                Flush();
+                fclose(File);
+                File = nullptr;
+                spdlog::info("Hook Trace: Wrote {} call records.", iRecordCount);
+            }
+        }
+    }
+
+    // Every stub and trampoline is packed in to one region reserved next to the game image, instead of
+    // safetyhook's global allocator spreading them out. Hooks created earlier sit lower in the region, so
+    // creation order keeps the per-frame hooks next to each other. Once installed the region is sealed
+    // read-execute and only made writable again while a late hook is being created.
+    namespace Arena
+    {
+        constexpr size_t ReserveSize = 64 * 1024;
+
+        std::shared_ptr<safetyhook::Allocator> Allocator;
+        uint8_t* Base = nullptr;
+        size_t Size = 0;
+        size_t HookCount = 0;
+        bool bSealed = false;
+        std::mutex Mutex;
+
+        // Blocks the allocator mapped outside the arena. Once the arena is full it quietly maps new RWX memory
+        // wherever it can, which the seal wouldn't cover, so those are tracked and protected along with it.
+        struct Overflow
+        {
+            uint8_t* base;
+            size_t size;
+        };
+        std::vector<Overflow> Overflows;
+
+        bool Init(HMODULE module)
+        {
+            Allocator = safetyhook::Allocator::create();
+
+            // Freed straight away, the allocator keeps the block and hands it out from the start.
+            auto reservation = Allocator->allocate_near({ reinterpret_cast<uint8_t*>(module) }, ReserveSize);
+            if (!reservation)
+            {
+                Allocator.reset();
+                return false;
+            }
+
+            Base = reservation->data();
+            Size = reservation->size();
+            return true;
+        }
+
+        bool InArena(const uint8_t* address)
+        {
+            return address >= Base && address < Base + Size;
+        }
+
+        // Bytes in use. Every free gap is filled with allocations pinned to the arena's own range, so the
+        // allocator can't reach for new memory, and whatever fit is free. The fill is released on return.
+        size_t Used()
+        {
+            std::scoped_lock lock{ Mutex };
+            std::vector<safetyhook::Allocation> fill;
+            size_t free = 0;
+            for (size_t chunk = std::bit_floor(Size); chunk; chunk /= 2)
+            {
+                while (auto allocation = Allocator->allocate_near({ Base, Base + Size - 1 }, chunk, Size - 1))
+                {
+                    free += allocation->size();
+                    fill.push_back(std::move(*allocation));
+                }
+            }
+            return Size - free;
+        }
+
+        size_t OverflowSize()
+        {
+            std::scoped_lock lock{ Mutex };
+            size_t size = 0;
+            for (const auto& overflow : Overflows)
+            {
+                size += overflow.size;
+            }
+            return size;
+        }
+
+        // Records the block holding address if it isn't the arena.
+        void Track(const uint8_t* address)
+        {
+            MEMORY_BASIC_INFORMATION info{};
+            if (!address || InArena(address) || !VirtualQuery(address, &info, sizeof(info)))
+            {
+                return;
+            }
+
+            auto base = reinterpret_cast<uint8_t*>(info.AllocationBase);
+            for (const auto& overflow : Overflows)
+            {
+                if (overflow.base == base)
+                {
+                    return;
+                }
+            }
+
+            size_t size = 0;
+            for (uint8_t* region = base; VirtualQuery(region, &info, sizeof(info)) && info.AllocationBase == base; region += info.RegionSize)
+            {
+                size += info.RegionSize;
+            }
+            Overflows.push_back({ base, size });
+            spdlog::error("Hook Arena: Arena is full, hook memory went to {} bytes at {:p} outside it.", size, static_cast<void*>(base));
+        }
+
+        // A mid hook's stub and trampoline aren't exposed, but the patched target jumps through both:
+        // rel32 to the trampoline, then through [rip] to the stub (or straight to the stub far from the arena).
+        void Track(const SafetyHookMid& hook)
+        {
+            uint8_t* address = hook ? hook.target() : nullptr;
+            for (int hop = 0; address && hop < 2; hop++)
+            {
+                if (address[0] == 0xE9)
+                {
+                    address += 5 + *reinterpret_cast<int32_t*>(address + 1);
+                }
+                else if (address[0] == 0xFF && address[1] == 0x25)
+                {
+                    address = *reinterpret_cast<uint8_t**>(address + 6 + *reinterpret_cast<int32_t*>(address + 2));
+                }
+                else
+                {
+                    break;
+                }
+                Track(address);
+            }
+        }
+
+        void Track(const SafetyHookInline& hook)
+        {
+            if (hook)
+            {
+                Track(hook.trampoline().data());
+            }
+        }
+
+        bool Protect(DWORD protect)
+        {
+            DWORD oldProtect;
+            bool bProtected = VirtualProtect(Base, Size, protect, &oldProtect);
+            for (const auto& overflow : Overflows)
+            {
+                bProtected = VirtualProtect(overflow.base, overflow.size, protect, &oldProtect) && bProtected;
+            }
+            return bProtected;
+        }
+
+        bool Seal()
+        {
+            std::scoped_lock lock{ Mutex };
+            bSealed = Allocator && Protect(PAGE_EXECUTE_READ);
+            return bSealed;
+        }
+
+        template<typename Create>
+        auto Install(Create create)
+        {
+            std::scoped_lock lock{ Mutex };
+            if (bSealed)
+            {
+                Protect(PAGE_EXECUTE_READWRITE);
+            }
+
+            auto hook = create();
+            HookCount += (bool)hook;
+            Track(hook);
+
+            if (bSealed)
+            {
+                Protect(PAGE_EXECUTE_READ);
+            }
+            return hook;
+        }
+
+        SafetyHookMid CreateMid(void* target, safetyhook::MidHookFn destination)
+        {
+            if (!Allocator)
+            {
+                return safetyhook::create_mid(target, destination);
+            }
+
+            return Install([&]
+                {
+                    auto hook = safetyhook::MidHook::create(Allocator, target, destination);
+                    return hook ? std::move(*hook) : SafetyHookMid{};
+                });
+        }
+
+        SafetyHookInline CreateInline(void* target, void* destination)
+        {
+            if (!Allocator)
+            {
+                return safetyhook::create_inline(target, destination);
+            }
+
+            return Install([&]
+                {
+                    auto hook = safetyhook::InlineHook::create(Allocator, target, destination);
+                    return hook ? std::move(*hook) : SafetyHookInline{};
+                });
+        }
+    }
+
+    template<size_t Index>
+    void Thunk(SafetyHookContext& ctx)
+    {
+        const auto& entry = Entries[Index];
+        Calls[Index].fetch_add(1, std::memory_order_relaxed);
+        if (!Trace::bEnabled)
+        {
+            entry.callback(ctx);
+            return;
+        }
+
+        thread_local std::vector<uint8_t> probesBefore;
+        thread_local std::vector<uint8_t> probesAfter;
+        Callbacks::Inputs inputs = Callbacks::Capture();
+        SafetyHookContext before = ctx;
+        Trace::CaptureProbes(entry, before, probesBefore);
+
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        entry.callback(ctx);
+        QueryPerformanceCounter(&end);
+
+        Trace::CaptureProbes(entry, ctx, probesAfter);
+        Trace::WriteCall((uint16_t)Index, inputs, before, probesBefore, ctx, probesAfter, start.QuadPart, (uint32_t)(end.QuadPart - start.QuadPart));
+    }
+
+    template<size_t... Index>
+    constexpr std::array<safetyhook::MidHookFn, sizeof...(Index)> MakeThunks(std::index_sequence<Index...>)
+    {
+        return { &Thunk<Index>... };
+    }
+
+    constexpr auto Thunks = MakeThunks(std::make_index_sequence<MaxHooks>{});
+
+    // Drop-in for safetyhook::create_mid. Hooks go straight to their callback unless tracing or call counting
+    // is enabled, in which case they are routed through a thunk that counts and records every call.
+    SafetyHookMid CreateMid(const char* name, void* target, safetyhook::MidHookFn callback, std::initializer_list<Probe> probes = {})
+    {
+        if ((!Trace::bEnabled && !bCountCalls) || EntryCount >= MaxHooks)
+        {
+            return Arena::CreateMid(target, callback);
+        }
+
+        auto id = EntryCount++;
+        Entries[id] = { name, callback, probes };
+        if (Trace::bEnabled)
+        {
+            Trace::WriteHook((uint16_t)id, Entries[id]);
+        }
+        return Arena::CreateMid(target, Thunks[id]);
+    }
+
+    // Drop-in for safetyhook::create_inline that places the trampoline in the arena.
+    SafetyHookInline CreateInline(void* target, void* destination)
+    {
+        return Arena::CreateInline(target, destination);
+    }
+}
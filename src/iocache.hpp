@@ -0,0 +1,583 @@
+#pragma once
+
+#include "stdafx.h"
+#include "frame.hpp"
+#include <spdlog/spdlog.h>
+
+namespace IOCache
+{
+    using CreateFileW_t = HANDLE(WINAPI*)(LPCWSTR, DWORD, DWORD, LPSECURITY_ATTRIBUTES, DWORD, DWORD, HANDLE);
+    using CreateFileA_t = HANDLE(WINAPI*)(LPCSTR, DWORD, DWORD, LPSECURITY_ATTRIBUTES, DWORD, DWORD, HANDLE);
+    using ReadFile_t = BOOL(WINAPI*)(HANDLE, LPVOID, DWORD, LPDWORD, LPOVERLAPPED);
+    using CloseHandle_t = BOOL(WINAPI*)(HANDLE);
+
+    CreateFileW_t CreateFileW_original = nullptr;
+    CreateFileA_t CreateFileA_original = nullptr;
+    ReadFile_t ReadFile_original = nullptr;
+    CloseHandle_t CloseHandle_original = nullptr;
+
+    // Settings
+    std::filesystem::path GameDirectory;
+    std::filesystem::path ManifestPath;
+    uint64_t MaxCacheBytes = 0;
+    double LoadGapSeconds = 2.0;
+
+    // A read-only view of a whole game file, shared by every handle the game opens on it.
+    struct MappedFile
+    {
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+        const uint8_t* view = nullptr;
+        uint64_t size = 0;
+        DWORD volume = 0;
+        uint64_t index = 0;
+        std::atomic<int64_t> lastUse = 0;
+
+        ~MappedFile()
+        {
+            if (view) UnmapViewOfFile(view);
+            if (mapping) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        }
+    };
+
+    struct OpenHandle
+    {
+        std::wstring path;
+        std::shared_ptr<MappedFile> mapped;
+    };
+
+    std::shared_mutex Mutex;
+    std::unordered_map<HANDLE, OpenHandle> Handles;
+    std::unordered_map<std::wstring, std::shared_ptr<MappedFile>> Cache;
+    std::unordered_map<std::wstring, uint32_t> OpenCounts;
+    uint64_t CachedBytes = 0;
+
+    // A load is a burst of file opens. Its key is the first file opened after a quiet period,
+    // and the manifest maps that key to the files the load went on to open last time.
+    struct Load
+    {
+        std::wstring key;
+        std::vector<std::wstring> files;
+        int64_t start = 0;
+        int64_t lastActivity = 0;
+        uint64_t reads = 0;
+        uint64_t hits = 0;
+        uint64_t bytes = 0;
+    };
+
+    std::mutex LoadMutex;
+    Load CurrentLoad;
+    std::map<std::wstring, std::vector<std::wstring>> Manifest;
+
+    // Statistics
+    std::atomic<uint64_t> TotalReads = 0;
+    std::atomic<uint64_t> TotalHits = 0;
+    std::atomic<uint64_t> TotalPrefetched = 0;
+    std::atomic<uint64_t> TotalEvicted = 0;
+
+    // Trace
+    FILE* TraceFile = nullptr;
+    std::mutex TraceMutex;
+
+    // Prefetch worker
+    std::mutex PrefetchMutex;
+    std::condition_variable PrefetchSignal;
+    std::deque<std::wstring> PrefetchQueue;
+    bool bSaveManifest = false;
+
+    void Trace(const char* op, const std::wstring& path, uint64_t offset, uint64_t bytes, int64_t durationTicks, bool hit)
+    {
+        if (!TraceFile)
+        {
+            return;
+        }
+
+        std::scoped_lock lock{ TraceMutex };
+        fwprintf(TraceFile, L"%.3f,%S,%s,%llu,%llu,%.1f,%d\n",
+            Frame::ToSeconds(Frame::Now()) * 1000.0, op, path.c_str(), offset, bytes, Frame::ToSeconds(durationTicks) * 1000000.0, hit ? 1 : 0);
+    }
+
+    // Absolute and lexically normal, without touching the disk. Empty if the name can't be resolved.
+    std::wstring Normalize(LPCWSTR fileName)
+    {
+        std::error_code ec;
+        auto path = std::filesystem::absolute(fileName, ec);
+        return ec ? std::wstring() : path.lexically_normal().wstring();
+    }
+
+    // path must be normalized. Both sides are then absolute, so a case-insensitive prefix check is enough.
+    bool IsGameFile(const std::wstring& path)
+    {
+        const std::wstring& directory = GameDirectory.native();
+        return path.size() > directory.size() && _wcsnicmp(path.c_str(), directory.c_str(), directory.size()) == 0 &&
+            (directory.back() == L'\\' || path[directory.size()] == L'\\');
+    }
+
+    // Unmaps the least recently used files no handle still refers to until size more bytes fit.
+    // Must be called with Mutex held exclusively.
+    bool Evict(uint64_t size)
+    {
+        while (CachedBytes + size > MaxCacheBytes)
+        {
+            auto oldest = Cache.end();
+            for (auto it = Cache.begin(); it != Cache.end(); ++it)
+            {
+                if (it->second.use_count() == 1 && (oldest == Cache.end() || it->second->lastUse < oldest->second->lastUse))
+                {
+                    oldest = it;
+                }
+            }
+            if (oldest == Cache.end())
+            {
+                return false;
+            }
+
+            CachedBytes -= oldest->second->size;
+            TotalEvicted++;
+            Cache.erase(oldest);
+        }
+        return true;
+    }
+
+    std::shared_ptr<MappedFile> Map(const std::wstring& path)
+    {
+        {
+            std::shared_lock lock{ Mutex };
+            if (auto it = Cache.find(path); it != Cache.end())
+            {
+                return it->second;
+            }
+        }
+
+        auto mapped = std::make_shared<MappedFile>();
+        mapped->file = CreateFileW_original(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        BY_HANDLE_FILE_INFORMATION info{};
+        if (mapped->file == INVALID_HANDLE_VALUE || !GetFileInformationByHandle(mapped->file, &info))
+        {
+            return nullptr;
+        }
+        uint64_t size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+        if (size == 0)
+        {
+            return nullptr;
+        }
+
+        std::unique_lock lock{ Mutex };
+
+        // Another thread may have mapped it while the file was being opened.
+        if (auto it = Cache.find(path); it != Cache.end())
+        {
+            return it->second;
+        }
+        if (!Evict(size))
+        {
+            return nullptr;
+        }
+
+        mapped->mapping = CreateFileMappingW(mapped->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        mapped->view = mapped->mapping ? reinterpret_cast<const uint8_t*>(MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        if (!mapped->view)
+        {
+            return nullptr;
+        }
+
+        mapped->size = size;
+        mapped->volume = info.dwVolumeSerialNumber;
+        mapped->index = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+        mapped->lastUse = Frame::Now();
+        CachedBytes += mapped->size;
+        Cache[path] = mapped;
+        return mapped;
+    }
+
+    // Forgets the mapping of path, so its section stops blocking writes to the file and later opens map it afresh.
+    // Reads in flight keep their view until they finish.
+    void Drop(const std::wstring& path)
+    {
+        std::unique_lock lock{ Mutex };
+        auto it = Cache.find(path);
+        if (it == Cache.end())
+        {
+            return;
+        }
+
+        for (auto& [handle, open] : Handles)
+        {
+            if (open.mapped == it->second)
+            {
+                open.mapped = nullptr;
+            }
+        }
+        CachedBytes -= it->second->size;
+        Cache.erase(it);
+    }
+
+    // Whether handle is still on the file that was mapped, at the size it was mapped. A handle closed behind
+    // CloseHandle_hooked's back can be reused for another file, and the file can grow or shrink under the mapping.
+    bool Matches(HANDLE handle, const MappedFile& mapped)
+    {
+        BY_HANDLE_FILE_INFORMATION info{};
+        return GetFileInformationByHandle(handle, &info) && info.dwVolumeSerialNumber == mapped.volume &&
+            (((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow) == mapped.index &&
+            (((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow) == mapped.size;
+    }
+
+    // Reading a view raises EXCEPTION_IN_PAGE_ERROR instead of failing if the disk underneath it does. False if it did.
+    bool CopyFromView(void* destination, const uint8_t* source, size_t size)
+    {
+        __try
+        {
+            memcpy(destination, source, size);
+            return true;
+        }
+        __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+        {
+            return false;
+        }
+    }
+
+    void SaveManifest(const std::map<std::wstring, std::vector<std::wstring>>& manifest)
+    {
+        std::wofstream file(ManifestPath);
+        for (const auto& [key, files] : manifest)
+        {
+            file << L"[" << key << L"]\n";
+            for (const auto& path : files)
+            {
+                file << path << L"\n";
+            }
+        }
+    }
+
+    void LoadManifest()
+    {
+        std::wifstream file(ManifestPath);
+        std::wstring line;
+        std::vector<std::wstring>* files = nullptr;
+        while (std::getline(file, line))
+        {
+            if (line.size() > 2 && line.front() == L'[' && line.back() == L']')
+            {
+                files = &Manifest[line.substr(1, line.size() - 2)];
+            }
+            else if (files && !line.empty())
+            {
+                files->push_back(line);
+            }
+        }
+        spdlog::info("IO Cache: Loaded {} recorded loads from manifest.", Manifest.size());
+    }
+
+    // Prefetches queued files and writes the manifest, keeping both off the game's file I/O path.
+    void PrefetchWorker()
+    {
+        while (true)
+        {
+            std::wstring path;
+            bool bSave = false;
+            {
+                std::unique_lock lock{ PrefetchMutex };
+                PrefetchSignal.wait(lock, [] { return !PrefetchQueue.empty() || bSaveManifest; });
+                std::swap(bSave, bSaveManifest);
+                if (!bSave)
+                {
+                    path = std::move(PrefetchQueue.front());
+                    PrefetchQueue.pop_front();
+                }
+            }
+
+            if (bSave)
+            {
+                std::map<std::wstring, std::vector<std::wstring>> manifest;
+                {
+                    std::scoped_lock lock{ LoadMutex };
+                    manifest = Manifest;
+                }
+                SaveManifest(manifest);
+                continue;
+            }
+
+            int64_t start = Frame::Now();
+            if (auto mapped = Map(path))
+            {
+                // Pull the whole file in to the page cache so the game's reads don't touch the disk.
+                WIN32_MEMORY_RANGE_ENTRY range{ const_cast<uint8_t*>(mapped->view), (SIZE_T)mapped->size };
+                PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+                TotalPrefetched++;
+                Trace("Prefetch", path, 0, mapped->size, Frame::Now() - start, false);
+            }
+        }
+    }
+
+    // Must be called with LoadMutex held.
+    void EndLoad()
+    {
+        if (CurrentLoad.key.empty())
+        {
+            return;
+        }
+
+        Manifest[CurrentLoad.key] = CurrentLoad.files;
+        {
+            std::scoped_lock queueLock{ PrefetchMutex };
+            bSaveManifest = true;
+            PrefetchSignal.notify_one();
+        }
+
+        spdlog::info("IO Cache: Load \"{}\": {} files, {} reads, {:.1f}% served from cache, {:.2f}MB in {:.0f}ms.",
+            std::filesystem::path(CurrentLoad.key).filename().string(), CurrentLoad.files.size(), CurrentLoad.reads,
+            CurrentLoad.reads ? CurrentLoad.hits * 100.0 / CurrentLoad.reads : 0.0,
+            CurrentLoad.bytes / (1024.0 * 1024.0), Frame::ToSeconds(CurrentLoad.lastActivity - CurrentLoad.start) * 1000.0);
+        CurrentLoad = {};
+    }
+
+    void OnOpen(const std::wstring& path)
+    {
+        std::scoped_lock lock{ LoadMutex };
+        int64_t now = Frame::Now();
+        if (CurrentLoad.key.empty() || Frame::ToSeconds(now - CurrentLoad.lastActivity) > LoadGapSeconds)
+        {
+            EndLoad();
+            CurrentLoad.key = path;
+            CurrentLoad.start = now;
+
+            // Seen this load before? Start pulling in the rest of its files.
+            if (auto it = Manifest.find(path); it != Manifest.end())
+            {
+                std::scoped_lock queueLock{ PrefetchMutex };
+                PrefetchQueue.insert(PrefetchQueue.end(), it->second.begin(), it->second.end());
+                PrefetchSignal.notify_one();
+            }
+        }
+
+        if (std::find(CurrentLoad.files.begin(), CurrentLoad.files.end(), path) == CurrentLoad.files.end())
+        {
+            CurrentLoad.files.push_back(path);
+        }
+        CurrentLoad.lastActivity = now;
+    }
+
+    void Track(HANDLE handle, std::wstring path)
+    {
+        OnOpen(path);
+
+        // Map files the game opens more than once, or that were already prefetched.
+        std::shared_ptr<MappedFile> mapped;
+        bool repeated = false;
+        {
+            std::unique_lock lock{ Mutex };
+            repeated = ++OpenCounts[path] > 1;
+            if (auto it = Cache.find(path); it != Cache.end())
+            {
+                mapped = it->second;
+            }
+        }
+        if (!mapped && repeated)
+        {
+            mapped = Map(path);
+        }
+
+        std::unique_lock lock{ Mutex };
+        Handles[handle] = { std::move(path), std::move(mapped) };
+    }
+
+    bool IsCacheable(DWORD access, DWORD disposition, DWORD flags)
+    {
+        return access == GENERIC_READ && disposition == OPEN_EXISTING && !(flags & FILE_FLAG_OVERLAPPED);
+    }
+
+    bool IsWrite(DWORD access, DWORD disposition)
+    {
+        return (access & (GENERIC_WRITE | GENERIC_ALL | FILE_WRITE_DATA | FILE_APPEND_DATA)) || disposition == CREATE_ALWAYS || disposition == TRUNCATE_EXISTING;
+    }
+
+    HANDLE WINAPI CreateFileW_hooked(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
+    {
+        int64_t start = Frame::Now();
+        bool bCacheable = lpFileName && IsCacheable(dwDesiredAccess, dwCreationDisposition, dwFlagsAndAttributes);
+        std::wstring path;
+        if (lpFileName && (bCacheable || IsWrite(dwDesiredAccess, dwCreationDisposition)))
+        {
+            path = Normalize(lpFileName);
+            if (!IsGameFile(path))
+            {
+                path.clear();
+            }
+        }
+
+        // A mapped section makes truncating or resizing the file fail with ERROR_USER_MAPPED_FILE.
+        if (!path.empty() && !bCacheable)
+        {
+            Drop(path);
+        }
+
+        HANDLE handle = CreateFileW_original(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            return handle;
+        }
+
+        if (bCacheable && !path.empty())
+        {
+            Trace("Open", path, 0, 0, Frame::Now() - start, false);
+            Track(handle, std::move(path));
+        }
+        else
+        {
+            // The handle value may be one a file tracked earlier had, if that was closed without going through CloseHandle_hooked.
+            std::unique_lock lock{ Mutex };
+            Handles.erase(handle);
+        }
+        return handle;
+    }
+
+    HANDLE WINAPI CreateFileA_hooked(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
+    {
+        WCHAR wideName[MAX_PATH] = { 0 };
+        if (!lpFileName || !MultiByteToWideChar(CP_ACP, 0, lpFileName, -1, wideName, MAX_PATH))
+        {
+            return CreateFileA_original(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
+        }
+        return CreateFileW_hooked(wideName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
+    }
+
+    BOOL WINAPI ReadFile_hooked(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped)
+    {
+        std::wstring path;
+        std::shared_ptr<MappedFile> mapped;
+        {
+            std::shared_lock lock{ Mutex };
+            auto it = Handles.find(hFile);
+            if (it == Handles.end())
+            {
+                return ReadFile_original(hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+            }
+            path = it->second.path;
+            mapped = it->second.mapped;
+        }
+
+        int64_t start = Frame::Now();
+        LARGE_INTEGER position{};
+        bool bPosition = false;
+        if (lpOverlapped)
+        {
+            position.QuadPart = ((LONGLONG)lpOverlapped->OffsetHigh << 32) | lpOverlapped->Offset;
+        }
+        else if (mapped || TraceFile)
+        {
+            bPosition = SetFilePointerEx(hFile, {}, &position, FILE_CURRENT);
+        }
+
+        BOOL result = FALSE;
+        bool hit = false;
+        DWORD bytesRead = 0;
+        if (mapped && bPosition && lpNumberOfBytesRead)
+        {
+            if (!Matches(hFile, *mapped))
+            {
+                Drop(path);
+            }
+            else
+            {
+                // Serve from the mapped view and keep the handle's file pointer where ReadFile would have left it.
+                uint64_t offset = std::min((uint64_t)position.QuadPart, mapped->size);
+                bytesRead = (DWORD)std::min<uint64_t>(nNumberOfBytesToRead, mapped->size - offset);
+                hit = CopyFromView(lpBuffer, mapped->view + offset, bytesRead);
+            }
+
+            if (hit)
+            {
+                SetFilePointerEx(hFile, LARGE_INTEGER{ .QuadPart = (LONGLONG)bytesRead }, nullptr, FILE_CURRENT);
+                *lpNumberOfBytesRead = bytesRead;
+                mapped->lastUse = start;
+                result = TRUE;
+            }
+        }
+
+        if (!hit)
+        {
+            result = ReadFile_original(hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+            bytesRead = lpNumberOfBytesRead ? *lpNumberOfBytesRead : 0;
+        }
+
+        TotalReads++;
+        TotalHits += hit;
+        Trace("Read", path, position.QuadPart, bytesRead, Frame::Now() - start, hit);
+        {
+            std::scoped_lock lock{ LoadMutex };
+            CurrentLoad.reads++;
+            CurrentLoad.hits += hit;
+            CurrentLoad.bytes += bytesRead;
+            CurrentLoad.lastActivity = Frame::Now();
+        }
+        return result;
+    }
+
+    BOOL WINAPI CloseHandle_hooked(HANDLE hObject)
+    {
+        {
+            std::unique_lock lock{ Mutex };
+            Handles.erase(hObject);
+        }
+        return CloseHandle_original(hObject);
+    }
+
+    void Init(const std::filesystem::path& gameDirectory, const std::filesystem::path& manifestPath, const std::filesystem::path& tracePath, int cacheSizeMB, bool bTrace)
+    {
+        GameDirectory = std::filesystem::absolute(gameDirectory).lexically_normal();
+        ManifestPath = manifestPath;
+        MaxCacheBytes = (uint64_t)cacheSizeMB * 1024 * 1024;
+
+        HMODULE kernel32 = GetModuleHandleW(L"kernel32.dll");
+        CreateFileW_original = reinterpret_cast<CreateFileW_t>(GetProcAddress(kernel32, "CreateFileW"));
+        CreateFileA_original = reinterpret_cast<CreateFileA_t>(GetProcAddress(kernel32, "CreateFileA"));
+        ReadFile_original = reinterpret_cast<ReadFile_t>(GetProcAddress(kernel32, "ReadFile"));
+        CloseHandle_original = reinterpret_cast<CloseHandle_t>(GetProcAddress(kernel32, "CloseHandle"));
+
+        if (bTrace)
+        {
+            if (_wfopen_s(&TraceFile, tracePath.c_str(), L"w") != 0)
+            {
+                TraceFile = nullptr;
+            }
+            if (TraceFile)
+            {
+                setvbuf(TraceFile, nullptr, _IOFBF, 64 * 1024);
+                fwprintf(TraceFile, L"time_ms,op,path,offset,bytes,duration_us,hit\n");
+            }
+        }
+
+        LoadManifest();
+        std::thread(PrefetchWorker).detach();
+    }
+
+    // Runs at process detach, where the other threads are already gone and may have died holding a lock.
+    // Anything still locked is skipped rather than waited on, earlier loads were saved when they ended.
+    void Shutdown()
+    {
+        if (LoadMutex.try_lock())
+        {
+            if (!CurrentLoad.key.empty())
+            {
+                Manifest[CurrentLoad.key] = CurrentLoad.files;
+                SaveManifest(Manifest);
+            }
+            LoadMutex.unlock();
+        }
+
+        uint64_t reads = TotalReads;
+        spdlog::info("IO Cache: {} reads, {:.1f}% served from cache, {} files prefetched, {} evicted, {:.2f}MB mapped.",
+            reads, reads ? TotalHits * 100.0 / reads : 0.0, TotalPrefetched.load(), TotalEvicted.load(), CachedBytes / (1024.0 * 1024.0));
+
+        if (TraceMutex.try_lock())
+        {
+            if (TraceFile)
+            {
+                fclose(TraceFile);
+                TraceFile = nullptr;
+            }
+            TraceMutex.unlock();
+        }
+    }
+}
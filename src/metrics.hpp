@@ -0,0 +1,150 @@
+#pragma once
+
+#include "stdafx.h"
+#include "frame.hpp"
+#include "hooks.hpp"
+#include "metrics_layout.hpp"
+#include <spdlog/spdlog.h>
+
+namespace Metrics
+{
+    static_assert(Hooks::MaxHooks <= MaxHooks, "Metrics has no room for every hook.");
+
+    Block* Shared = nullptr;
+    constexpr DWORD UpdateIntervalMs = 1000;
+
+    // Whether the process that last published the block is still running.
+    bool WriterAlive(uint32_t processId)
+    {
+        if (!processId || processId == GetCurrentProcessId())
+        {
+            return false;
+        }
+        HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, processId);
+        if (!process)
+        {
+            return false;
+        }
+        bool bAlive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+        CloseHandle(process);
+        return bAlive;
+    }
+
+    bool Init()
+    {
+        HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(Block), L"Local\\SO4Fix_Metrics");
+        if (!mapping)
+        {
+            return false;
+        }
+        bool bExisted = GetLastError() == ERROR_ALREADY_EXISTS;
+
+        Shared = reinterpret_cast<Block*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Block)));
+        if (!Shared)
+        {
+            CloseHandle(mapping);
+            return false;
+        }
+
+        // A reader can keep the mapping alive after the game exits, so it may hold a previous run's data
+        // or seqlocks left odd by a crash. Only take it over if its writer is gone.
+        if (bExisted)
+        {
+            uint32_t processId = Shared->processId;
+            if (Shared->magic == Magic && WriterAlive(processId))
+            {
+                spdlog::error("Live Metrics: Shared memory is already being published by process {}.", processId);
+                UnmapViewOfFile(Shared);
+                CloseHandle(mapping);
+                Shared = nullptr;
+                return false;
+            }
+            spdlog::info("Live Metrics: Resetting shared memory left by a previous run (process {}).", processId);
+        }
+        Reset(*Shared, GetCurrentProcessId());
+
+        // Hooks need to go through the counting thunks.
+        Hooks::bCountCalls = true;
+        return true;
+    }
+
+    // The init thread and the Present hook both publish the resolution, and a seqlock takes one writer at a time.
+    std::mutex ResolutionMutex;
+
+    void PublishResolution(int width, int height, float aspectRatio, float nativeAspect)
+    {
+        if (Shared)
+        {
+            std::scoped_lock lock{ ResolutionMutex };
+            uint32_t aspectClass = aspectRatio > nativeAspect ? Wider : aspectRatio < 1.60f ? Narrower : Native;
+            Shared->resolution.Write({ width, height, aspectRatio, aspectClass });
+        }
+    }
+
+    void PublishStartup(int64_t startupTicks, int64_t patternScanTicks, uint64_t patternScans)
+    {
+        if (Shared)
+        {
+            Shared->startup.Write({ (float)(Frame::ToSeconds(startupTicks) * 1000.0), (float)(Frame::ToSeconds(patternScanTicks) * 1000.0),
+                (uint32_t)patternScans, (uint32_t)Hooks::EntryCount });
+        }
+    }
+
+    // Called once per frame on the render thread.
+    void OnFrame()
+    {
+        if (!Shared)
+        {
+            return;
+        }
+
+        Frames frames{};
+        frames.frameCount = Frame::FrameCount;
+        frames.lastMs = (float)(Frame::LastFrametime * 1000.0);
+
+        size_t count = (size_t)std::min<uint64_t>(frames.frameCount, FrameHistory);
+        float total = 0.0f;
+        for (size_t i = 0; i < count; i++)
+        {
+            frames.historyMs[i] = Frame::History[(frames.frameCount - count + i) % Frame::HistorySize];
+            total += frames.historyMs[i];
+        }
+        frames.averageMs = count ? total / count : 0.0f;
+        Shared->frames.Write(frames);
+    }
+
+    // Publishes hook call rates once a second.
+    void UpdateThread()
+    {
+        std::array<uint64_t, MaxHooks> lastCalls{};
+        int64_t lastTick = Frame::Now();
+        while (true)
+        {
+            Sleep(UpdateIntervalMs);
+
+            int64_t now = Frame::Now();
+            double elapsed = Frame::ToSeconds(now - lastTick);
+            lastTick = now;
+
+            size_t hookCount = std::min(Hooks::EntryCount, MaxHooks);
+            for (size_t i = 0; i < hookCount; i++)
+            {
+                HookRate rate{};
+                strncpy_s(rate.name, Hooks::Entries[i].name, _TRUNCATE);
+                rate.totalCalls = Hooks::Calls[i].load(std::memory_order_relaxed);
+                rate.callsPerSecond = (float)((rate.totalCalls - lastCalls[i]) / elapsed);
+                lastCalls[i] = rate.totalCalls;
+                Shared->hooks[i].Write(rate);
+            }
+            Shared->hookCount.store((uint32_t)hookCount, std::memory_order_release);
+        }
+    }
+
+    void Start()
+    {
+        if (Shared)
+        {
+            std::thread(UpdateThread).detach();
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+// Live metrics shared memory layout, shared by Metrics and tools/metrics. Kept free of Windows so
+// readers on any platform can build it.
+//
+// Open "Local\SO4Fix_Metrics" read-only and check the header with Valid() before reading. Bump Version
+// whenever anything below changes; the static_asserts at the bottom pin the layout readers depend on.
+//
+// Each field is guarded by its own seqlock: the writer makes seq odd, writes, then makes it even again.
+// Readers copy the value between two reads of seq and retry if they differ or are odd.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Metrics
+{
+    constexpr uint32_t Magic = 0x4D344F53; // "SO4M"
+    constexpr uint32_t Version = 1;
+    constexpr size_t MaxHooks = 64;
+    constexpr size_t FrameHistory = 64;
+    constexpr int ReadRetries = 1000;
+
+    template<typename T>
+    struct alignas(64) Seqlocked
+    {
+        std::atomic<uint32_t> seq;
+        T value;
+
+        void Write(const T& newValue)
+        {
+            uint32_t s = seq.load(std::memory_order_relaxed);
+            seq.store(s + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy(&value, &newValue, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_release);
+            seq.store(s + 2, std::memory_order_relaxed);
+        }
+
+        // False if the writer kept the value busy for every retry, e.g. it died mid-write.
+        bool Read(T& out) const
+        {
+            for (int i = 0; i < ReadRetries; i++)
+            {
+                uint32_t before = seq.load(std::memory_order_acquire);
+                if (before & 1)
+                {
+                    continue;
+                }
+                memcpy(&out, &value, sizeof(T));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq.load(std::memory_order_relaxed) == before)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    enum AspectClass : uint32_t
+    {
+        Native = 0, // 16:9 to 16:10
+        Wider = 1,  // Wider than 16:9, HUD is centred
+        Narrower = 2, // Narrower than 16:10, HUD is letterboxed
+    };
+
+    struct Resolution
+    {
+        int32_t width;
+        int32_t height;
+        float aspectRatio;
+        uint32_t aspectClass;
+    };
+
+    struct Startup
+    {
+        float startupMs;
+        float patternScanMs;
+        uint32_t patternScans;
+        uint32_t hooks;
+    };
+
+    struct Frames
+    {
+        uint64_t frameCount;
+        float lastMs;
+        float averageMs;
+        float historyMs[FrameHistory]; // Oldest first
+    };
+
+    struct HookRate
+    {
+        char name[48];
+        uint64_t totalCalls;
+        float callsPerSecond;
+    };
+
+    struct Block
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;
+        uint32_t processId;
+        Seqlocked<Resolution> resolution;
+        Seqlocked<Startup> startup;
+        Seqlocked<Frames> frames;
+        std::atomic<uint32_t> hookCount;
+        Seqlocked<HookRate> hooks[MaxHooks];
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == 4, "Seqlocks must be plain 32-bit words in shared memory.");
+    static_assert(sizeof(Resolution) == 16 && sizeof(Startup) == 16 && sizeof(Frames) == 272 && sizeof(HookRate) == 64);
+    static_assert(offsetof(Block, magic) == 0 && offsetof(Block, version) == 4 && offsetof(Block, size) == 8 && offsetof(Block, processId) == 12);
+    static_assert(offsetof(Block, resolution) == 64 && offsetof(Block, startup) == 128 && offsetof(Block, frames) == 192);
+    static_assert(offsetof(Block, hookCount) == 512 && offsetof(Block, hooks) == 576);
+    static_assert(sizeof(Seqlocked<HookRate>) == 128 && sizeof(Block) == 8768);
+
+    // Clears whatever a previous writer left behind, including seqlocks it died holding, and publishes a fresh header.
+    // magic is cleared first so readers drop the block while it is being reset.
+    void Reset(Block& block, uint32_t processId)
+    {
+        reinterpret_cast<std::atomic<uint32_t>&>(block.magic).store(0, std::memory_order_release);
+        memset(reinterpret_cast<uint8_t*>(&block) + sizeof(block.magic), 0, sizeof(Block) - sizeof(block.magic));
+        block.version = Version;
+        block.size = sizeof(Block);
+        block.processId = processId;
+        reinterpret_cast<std::atomic<uint32_t>&>(block.magic).store(Magic, std::memory_order_release);
+    }
+
+    // Whether a mapping of mappedSize bytes holds a block this build can read.
+    bool Valid(const Block& block, size_t mappedSize)
+    {
+        if (mappedSize < sizeof(Block) || reinterpret_cast<const std::atomic<uint32_t>&>(block.magic).load(std::memory_order_acquire) != Magic)
+        {
+            return false;
+        }
+        return block.version == Version && block.size == sizeof(Block);
+    }
+}
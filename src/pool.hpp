@@ -0,0 +1,307 @@
+#pragma once
+
+#include "stdafx.h"
+#include "hooks.hpp"
+#include "pool_core.hpp"
+#include <spdlog/spdlog.h>
+
+namespace Pool
+{
+    HANDLE ProcessHeap = nullptr;
+    std::atomic<uint64_t> LargeAllocs = 0;
+    std::atomic<uint64_t> CrossHeapFrees = 0;
+
+    // Heap API replacements
+    using HeapAlloc_t = LPVOID(WINAPI*)(HANDLE, DWORD, SIZE_T);
+    using HeapFree_t = BOOL(WINAPI*)(HANDLE, DWORD, LPVOID);
+    using HeapReAlloc_t = LPVOID(WINAPI*)(HANDLE, DWORD, LPVOID, SIZE_T);
+    using HeapSize_t = SIZE_T(WINAPI*)(HANDLE, DWORD, LPCVOID);
+
+    HeapAlloc_t HeapAlloc_original = nullptr;
+
+    // Pool pointers can leave the game: other DLLs free them with HeapFree, and the CRT's own free, _msize,
+    // realloc, _recalloc and _expand go through HeapFree/HeapSize/HeapReAlloc. So those three are inline hooked
+    // in ntdll, where kernel32 and kernelbase forward them, which covers every caller: modules loaded later,
+    // delay loads and GetProcAddress included. HeapAlloc is only hooked in the game's imports.
+    SafetyHookInline HeapFree_hook;
+    SafetyHookInline HeapReAlloc_hook;
+    SafetyHookInline HeapSize_hook;
+    std::atomic<HeapFree_t> HeapFree_original = nullptr;
+    std::atomic<HeapReAlloc_t> HeapReAlloc_original = nullptr;
+    std::atomic<HeapSize_t> HeapSize_original = nullptr;
+
+    // A hook goes live before its trampoline is stored. Other threads wait that out, but the installing thread can't
+    // wait for itself and safetyhook frees its own bookkeeping on the way out, so its frees are held until then.
+    std::atomic<DWORD> InstallingThread = 0;
+    struct HeldFree
+    {
+        HANDLE heap;
+        DWORD flags;
+        LPVOID mem;
+    };
+    std::array<HeldFree, 64> HeldFrees;
+    size_t HeldCount = 0;
+
+    template<typename T>
+    T Original(const std::atomic<T>& original)
+    {
+        T function;
+        while (!(function = original.load(std::memory_order_acquire)))
+        {
+            YieldProcessor();
+        }
+        return function;
+    }
+
+    bool IsInstalling()
+    {
+        return InstallingThread.load(std::memory_order_relaxed) == GetCurrentThreadId();
+    }
+
+    LPVOID WINAPI HeapAlloc_hooked(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes)
+    {
+        if (hHeap == ProcessHeap)
+        {
+            if (void* p = (dwFlags & HEAP_ZERO_MEMORY) ? AllocateZeroed(dwBytes) : Allocate(dwBytes))
+            {
+                return p;
+            }
+            LargeAllocs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return HeapAlloc_original(hHeap, dwFlags, dwBytes);
+    }
+
+    BOOL WINAPI HeapFree_hooked(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem)
+    {
+        if (Owns(lpMem))
+        {
+            if (hHeap != ProcessHeap)
+            {
+                CrossHeapFrees++;
+            }
+            Free(lpMem);
+            return TRUE;
+        }
+        if (!HeapFree_original.load(std::memory_order_acquire) && IsInstalling())
+        {
+            // Past the end it leaks, which is harmless for a handful of frees during startup.
+            if (HeldCount < HeldFrees.size())
+            {
+                HeldFrees[HeldCount++] = { hHeap, dwFlags, lpMem };
+            }
+            return TRUE;
+        }
+        return Original(HeapFree_original)(hHeap, dwFlags, lpMem);
+    }
+
+    SIZE_T WINAPI HeapSize_hooked(HANDLE hHeap, DWORD dwFlags, LPCVOID lpMem)
+    {
+        if (Owns(lpMem))
+        {
+            return SizeOf(lpMem);
+        }
+        if (!HeapSize_original.load(std::memory_order_acquire) && IsInstalling())
+        {
+            return (SIZE_T)-1;
+        }
+        return Original(HeapSize_original)(hHeap, dwFlags, lpMem);
+    }
+
+    LPVOID WINAPI HeapReAlloc_hooked(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes)
+    {
+        if (!Owns(lpMem))
+        {
+            if (!HeapReAlloc_original.load(std::memory_order_acquire) && IsInstalling())
+            {
+                return nullptr;
+            }
+            return Original(HeapReAlloc_original)(hHeap, dwFlags, lpMem, dwBytes);
+        }
+
+        // _expand comes through here too.
+        size_t oldSize = SizeOf(lpMem);
+        if (dwFlags & HEAP_REALLOC_IN_PLACE_ONLY)
+        {
+            return dwBytes <= oldSize ? lpMem : nullptr;
+        }
+        if (void* p = Reallocate(lpMem, dwBytes, (dwFlags & HEAP_ZERO_MEMORY) != 0))
+        {
+            return p;
+        }
+
+        // Too big for the pool, or the pool is out of space.
+        LargeAllocs.fetch_add(1, std::memory_order_relaxed);
+        LPVOID p = HeapAlloc_original(ProcessHeap, dwFlags & HEAP_ZERO_MEMORY, dwBytes);
+        if (p)
+        {
+            memcpy(p, lpMem, std::min<size_t>(oldSize, dwBytes));
+            Free(lpMem);
+        }
+        return p;
+    }
+
+    // CRT replacements, for games that import the CRT heap functions instead of linking them statically.
+    using malloc_t = void* (__cdecl*)(size_t);
+    using free_t = void(__cdecl*)(void*);
+    using realloc_t = void* (__cdecl*)(void*, size_t);
+    using calloc_t = void* (__cdecl*)(size_t, size_t);
+    using msize_t = size_t(__cdecl*)(void*);
+
+    malloc_t malloc_original = nullptr;
+    free_t free_original = nullptr;
+    realloc_t realloc_original = nullptr;
+    calloc_t calloc_original = nullptr;
+    msize_t msize_original = nullptr;
+
+    void* __cdecl malloc_hooked(size_t size)
+    {
+        if (void* p = Allocate(size))
+        {
+            return p;
+        }
+        return malloc_original(size);
+    }
+
+    void* __cdecl calloc_hooked(size_t count, size_t size)
+    {
+        if (!size || count <= MaxSmallSize / size)
+        {
+            if (void* p = AllocateZeroed(count * size))
+            {
+                return p;
+            }
+        }
+        return calloc_original(count, size);
+    }
+
+    void __cdecl free_hooked(void* p)
+    {
+        if (Owns(p))
+        {
+            Free(p);
+            return;
+        }
+        free_original(p);
+    }
+
+    size_t __cdecl msize_hooked(void* p)
+    {
+        return Owns(p) ? SizeOf(p) : msize_original(p);
+    }
+
+    void* __cdecl realloc_hooked(void* p, size_t size)
+    {
+        if (!Owns(p))
+        {
+            return realloc_original(p, size);
+        }
+        if (size == 0)
+        {
+            Free(p);
+            return nullptr;
+        }
+
+        if (void* newP = Reallocate(p, size, false))
+        {
+            return newP;
+        }
+
+        size_t oldSize = SizeOf(p);
+        void* newP = malloc_original(size);
+        if (newP)
+        {
+            memcpy(newP, p, std::min(oldSize, size));
+            Free(p);
+        }
+        return newP;
+    }
+
+    template<typename T>
+    bool HookRelease(const char* name, void* detour, SafetyHookInline& hook, std::atomic<T>& original)
+    {
+        void* target = reinterpret_cast<void*>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), name));
+        if (!target || target != reinterpret_cast<void*>(GetProcAddress(GetModuleHandleW(L"kernelbase.dll"), name)))
+        {
+            spdlog::error("Pooled Heap: kernel32 and kernelbase don't share {}, so one hook can't cover every caller.", name);
+            return false;
+        }
+
+        hook = Hooks::CreateInline(target, detour);
+        if (!hook)
+        {
+            spdlog::error("Pooled Heap: Failed to hook {}.", name);
+            return false;
+        }
+        original.store(hook.original<T>(), std::memory_order_release);
+        return true;
+    }
+
+    // Must run before anything hands out pool pointers. HeapFree goes last: until it is in, nothing owns a pool pointer.
+    bool HookReleaseEverywhere()
+    {
+        InstallingThread = GetCurrentThreadId();
+        bool bHooked = HookRelease("HeapSize", reinterpret_cast<void*>(HeapSize_hooked), HeapSize_hook, HeapSize_original) &&
+            HookRelease("HeapReAlloc", reinterpret_cast<void*>(HeapReAlloc_hooked), HeapReAlloc_hook, HeapReAlloc_original) &&
+            HookRelease("HeapFree", reinterpret_cast<void*>(HeapFree_hooked), HeapFree_hook, HeapFree_original);
+        InstallingThread = 0;
+
+        for (size_t i = 0; i < HeldCount; i++)
+        {
+            HeapFree_original.load()(HeldFrees[i].heap, HeldFrees[i].flags, HeldFrees[i].mem);
+        }
+        HeldCount = 0;
+        return bHooked;
+    }
+
+    bool Init(size_t reserveMB)
+    {
+        if (!Reserve(reserveMB * 1024 * 1024))
+        {
+            return false;
+        }
+
+        ProcessHeap = GetProcessHeap();
+        HMODULE kernel32 = GetModuleHandleW(L"kernel32.dll");
+        HeapAlloc_original = reinterpret_cast<HeapAlloc_t>(GetProcAddress(kernel32, "HeapAlloc"));
+
+        if (HMODULE ucrtbase = GetModuleHandleW(L"ucrtbase.dll"))
+        {
+            malloc_original = reinterpret_cast<malloc_t>(GetProcAddress(ucrtbase, "malloc"));
+            free_original = reinterpret_cast<free_t>(GetProcAddress(ucrtbase, "free"));
+            realloc_original = reinterpret_cast<realloc_t>(GetProcAddress(ucrtbase, "realloc"));
+            calloc_original = reinterpret_cast<calloc_t>(GetProcAddress(ucrtbase, "calloc"));
+            msize_original = reinterpret_cast<msize_t>(GetProcAddress(ucrtbase, "_msize"));
+        }
+        return true;
+    }
+
+    void Report()
+    {
+        spdlog::info("Pooled Heap: Size class report (class size: allocs / frees / live blocks / spans / utilisation):");
+        uint64_t totalCommitted = 0;
+        uint64_t totalLive = 0;
+        for (size_t cls = 0; cls < NumClasses; cls++)
+        {
+            uint64_t allocs = Stats[cls].allocs;
+            uint64_t frees = Stats[cls].frees;
+            uint64_t spans = Stats[cls].spans;
+            if (!spans)
+            {
+                continue;
+            }
+
+            uint64_t live = allocs > frees ? allocs - frees : 0;
+            uint64_t committed = spans * SpanSize;
+            uint64_t liveBytes = live * ClassSizes[cls];
+            totalCommitted += committed;
+            totalLive += liveBytes;
+            spdlog::info("Pooled Heap: {:>5}: {} / {} / {} / {} / {:.1f}%", ClassSizes[cls], allocs, frees, live, spans, liveBytes * 100.0 / committed);
+        }
+
+        // Free blocks sitting in committed spans are the pool's fragmentation.
+        spdlog::info("Pooled Heap: {:.2f}MB committed, {:.2f}MB live, {:.1f}% fragmentation.",
+            totalCommitted / (1024.0 * 1024.0), totalLive / (1024.0 * 1024.0), totalCommitted ? (totalCommitted - totalLive) * 100.0 / totalCommitted : 0.0);
+        spdlog::info("Pooled Heap: {} large allocations passed through, {} cross-heap frees, {} times out of pool space.",
+            LargeAllocs.load(), CrossHeapFrees.load(), OutOfSpace.load());
+    }
+}
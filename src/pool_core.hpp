@@ -0,0 +1,334 @@
+#pragma once
+
+// Size-class allocator behind the pooled heap. Kept free of the heap hooks so tools/pool can build and
+// stress it on its own; only reserving and committing address space is platform specific.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace Pool
+{
+    // Small allocations come from fixed size classes carved out of 64 KB spans inside one reserved region.
+    // A pointer belongs to the pool if it falls inside the region, and its span records its size class.
+    // Anything else (large allocations, private heaps, memory allocated before the hooks went in) goes to the original functions.
+    constexpr size_t SpanSize = 64 * 1024;
+    constexpr std::array<uint32_t, 28> ClassSizes = {
+        16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384,
+        448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096 };
+    constexpr size_t NumClasses = ClassSizes.size();
+    constexpr size_t MaxSmallSize = 4096;
+    constexpr uint8_t NoClass = 0xFF;
+
+    // Per thread cache sizes: refill/flush in batches so the central lists are rarely touched.
+    constexpr uint32_t BatchSize = 32;
+    constexpr uint32_t MaxCached = 64;
+
+    uint8_t* Base = nullptr;
+    size_t ReserveSize = 0;
+    std::atomic<size_t> NextSpan = 0;
+    std::vector<uint8_t> SpanClass;
+    std::array<uint8_t, MaxSmallSize / 16 + 1> SizeToClass{};
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct CentralList
+    {
+        std::mutex mutex;
+        FreeBlock* head = nullptr;
+    };
+    std::array<CentralList, NumClasses> Central;
+
+    struct ClassStats
+    {
+        std::atomic<uint64_t> allocs = 0;
+        std::atomic<uint64_t> frees = 0;
+        std::atomic<uint64_t> spans = 0;
+    };
+    std::array<ClassStats, NumClasses> Stats;
+    std::atomic<uint64_t> OutOfSpace = 0;
+
+    uint8_t* ReserveMemory(size_t size)
+    {
+#ifdef _WIN32
+        return reinterpret_cast<uint8_t*>(VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS));
+#else
+        void* memory = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        return memory == MAP_FAILED ? nullptr : reinterpret_cast<uint8_t*>(memory);
+#endif
+    }
+
+    bool CommitMemory(uint8_t* memory, size_t size)
+    {
+#ifdef _WIN32
+        return VirtualAlloc(memory, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+        return mprotect(memory, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+    }
+
+    // Reserves the region and builds the size lookup. Nothing is committed until a class needs a span.
+    bool Reserve(size_t reserveBytes)
+    {
+        ReserveSize = reserveBytes;
+        Base = ReserveMemory(ReserveSize);
+        if (!Base)
+        {
+            return false;
+        }
+
+        SpanClass.assign(ReserveSize / SpanSize, NoClass);
+        for (size_t i = 0, cls = 0; i < SizeToClass.size(); i++)
+        {
+            while (ClassSizes[cls] < i * 16)
+            {
+                cls++;
+            }
+            SizeToClass[i] = (uint8_t)cls;
+        }
+        return true;
+    }
+
+    bool Owns(const void* p)
+    {
+        return p >= Base && p < Base + ReserveSize;
+    }
+
+    uint8_t ClassOf(const void* p)
+    {
+        return SpanClass[((const uint8_t*)p - Base) / SpanSize];
+    }
+
+    // Commits a new span for a size class and pushes its blocks on to the central list. Central lock must be held.
+    bool Grow(size_t cls)
+    {
+        size_t span = NextSpan++;
+        if ((span + 1) * SpanSize > ReserveSize)
+        {
+            OutOfSpace++;
+            return false;
+        }
+
+        uint8_t* memory = Base + span * SpanSize;
+        if (!CommitMemory(memory, SpanSize))
+        {
+            OutOfSpace++;
+            return false;
+        }
+
+        SpanClass[span] = (uint8_t)cls;
+        size_t size = ClassSizes[cls];
+        auto& central = Central[cls];
+        for (size_t offset = (SpanSize / size - 1) * size; offset != (size_t)-size; offset -= size)
+        {
+            auto block = reinterpret_cast<FreeBlock*>(memory + offset);
+            block->next = central.head;
+            central.head = block;
+        }
+        Stats[cls].spans++;
+        return true;
+    }
+
+    void ReturnToCentral(size_t cls, FreeBlock* head, FreeBlock* tail)
+    {
+        auto& central = Central[cls];
+        std::scoped_lock lock{ central.mutex };
+        tail->next = central.head;
+        central.head = head;
+    }
+
+    // Counts are kept per thread and added to Stats every StatsBatch operations, so the fast path touches no shared cache lines.
+    constexpr uint32_t StatsBatch = 256;
+
+    struct ThreadCache
+    {
+        std::array<FreeBlock*, NumClasses> heads{};
+        std::array<uint32_t, NumClasses> counts{};
+        std::array<uint32_t, NumClasses> allocs{};
+        std::array<uint32_t, NumClasses> frees{};
+        uint32_t pending = 0;
+        bool bOwned = false;
+
+        bool Refill(size_t cls);
+
+        void Flush(size_t cls, uint32_t count)
+        {
+            FreeBlock* head = heads[cls];
+            FreeBlock* tail = head;
+            for (uint32_t i = 1; i < count && tail->next; i++)
+            {
+                tail = tail->next;
+            }
+            heads[cls] = tail->next;
+            counts[cls] -= count;
+            ReturnToCentral(cls, head, tail);
+        }
+
+        void PublishStats()
+        {
+            for (size_t cls = 0; cls < NumClasses; cls++)
+            {
+                if (allocs[cls] || frees[cls])
+                {
+                    Stats[cls].allocs.fetch_add(allocs[cls], std::memory_order_relaxed);
+                    Stats[cls].frees.fetch_add(frees[cls], std::memory_order_relaxed);
+                    allocs[cls] = 0;
+                    frees[cls] = 0;
+                }
+            }
+            pending = 0;
+        }
+
+        void Count(std::array<uint32_t, NumClasses>& counter, size_t cls)
+        {
+            counter[cls]++;
+            if (++pending == StatsBatch)
+            {
+                PublishStats();
+            }
+        }
+
+        // Blocks cached by a thread that exits go back to the central lists.
+        void Release()
+        {
+            for (size_t cls = 0; cls < NumClasses; cls++)
+            {
+                if (heads[cls])
+                {
+                    Flush(cls, counts[cls]);
+                }
+            }
+            PublishStats();
+        }
+    };
+
+    // The cache itself has no constructor or destructor, so reaching it is a plain TLS access with no guard.
+    // CacheOwner's destructor releases it at thread exit; it is only touched on a thread's first refill.
+    constinit thread_local ThreadCache Cache;
+
+    struct CacheOwner
+    {
+        ~CacheOwner()
+        {
+            Cache.Release();
+        }
+    };
+    thread_local CacheOwner Owner;
+
+    bool ThreadCache::Refill(size_t cls)
+    {
+        if (!bOwned)
+        {
+            [[maybe_unused]] CacheOwner* owner = &Owner;
+            bOwned = true;
+        }
+
+        auto& central = Central[cls];
+        std::scoped_lock lock{ central.mutex };
+        if (!central.head && !Grow(cls))
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < BatchSize && central.head; i++)
+        {
+            FreeBlock* block = central.head;
+            central.head = block->next;
+            block->next = heads[cls];
+            heads[cls] = block;
+            counts[cls]++;
+        }
+        return true;
+    }
+
+    // Adds the calling thread's pending counts to Stats. Other threads' lag by at most StatsBatch operations each.
+    void PublishStats()
+    {
+        Cache.PublishStats();
+    }
+
+    // Null if size is over MaxSmallSize or the pool is out of space; callers fall back to the original allocator.
+    void* Allocate(size_t size)
+    {
+        if (size > MaxSmallSize)
+        {
+            return nullptr;
+        }
+
+        size_t cls = SizeToClass[(std::max<size_t>(size, 1) + 15) / 16];
+        auto& cache = Cache;
+        if (!cache.heads[cls] && !cache.Refill(cls))
+        {
+            return nullptr;
+        }
+
+        FreeBlock* block = cache.heads[cls];
+        cache.heads[cls] = block->next;
+        cache.counts[cls]--;
+        cache.Count(cache.allocs, cls);
+        return block;
+    }
+
+    void Free(void* p)
+    {
+        size_t cls = ClassOf(p);
+        auto& cache = Cache;
+        auto block = reinterpret_cast<FreeBlock*>(p);
+        block->next = cache.heads[cls];
+        cache.heads[cls] = block;
+        if (++cache.counts[cls] > MaxCached)
+        {
+            cache.Flush(cls, BatchSize);
+        }
+        cache.Count(cache.frees, cls);
+    }
+
+    size_t SizeOf(const void* p)
+    {
+        return ClassSizes[ClassOf(p)];
+    }
+
+    // Zeroes the whole block, not just the request: HeapSize and _msize report the class size, so callers
+    // such as _recalloc treat everything up to it as already initialised.
+    void* AllocateZeroed(size_t size)
+    {
+        void* p = Allocate(size);
+        if (p)
+        {
+            memset(p, 0, SizeOf(p));
+        }
+        return p;
+    }
+
+    // Realloc within the pool. Stays in place while the block fits and isn't less than half used.
+    // Otherwise a new pool block is taken (null if there is none, and p is left alone); with bZero
+    // everything past the old block is zeroed.
+    void* Reallocate(void* p, size_t size, bool bZero)
+    {
+        size_t oldSize = SizeOf(p);
+        if (size <= oldSize && size > oldSize / 2)
+        {
+            return p;
+        }
+
+        void* newP = bZero ? AllocateZeroed(size) : Allocate(size);
+        if (newP)
+        {
+            memcpy(newP, p, std::min(oldSize, size));
+            Free(p);
+        }
+        return newP;
+    }
+}
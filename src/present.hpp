@@ -0,0 +1,474 @@
+#pragma once
+
+#include "stdafx.h"
+#include "frame.hpp"
+#include "hooks.hpp"
+#include <spdlog/spdlog.h>
+
+namespace Presentation
+{
+    using CreateDXGIFactory1_t = HRESULT(WINAPI*)(REFIID, void**);
+    using CreateSwapChain_t = HRESULT(STDMETHODCALLTYPE*)(IDXGIFactory*, IUnknown*, DXGI_SWAP_CHAIN_DESC*, IDXGISwapChain**);
+    using CreateSwapChainForHwnd_t = HRESULT(STDMETHODCALLTYPE*)(IDXGIFactory2*, IUnknown*, HWND, const DXGI_SWAP_CHAIN_DESC1*, const DXGI_SWAP_CHAIN_FULLSCREEN_DESC*, IDXGIOutput*, IDXGISwapChain1**);
+    using Present_t = HRESULT(STDMETHODCALLTYPE*)(IDXGISwapChain*, UINT, UINT);
+    using ResizeBuffers_t = HRESULT(STDMETHODCALLTYPE*)(IDXGISwapChain*, UINT, UINT, UINT, DXGI_FORMAT, UINT);
+
+    // Vtable slots
+    constexpr size_t CreateSwapChainIndex = 10; // IDXGIFactory::CreateSwapChain
+    constexpr size_t CreateSwapChainForHwndIndex = 15; // IDXGIFactory2::CreateSwapChainForHwnd
+    constexpr size_t PresentIndex = 8;          // IDXGISwapChain::Present
+    constexpr size_t ResizeBuffersIndex = 13;   // IDXGISwapChain::ResizeBuffers
+
+    constexpr UINT BaselineFrameLatency = 3; // DXGI default
+    constexpr DWORD WaitTimeoutMs = 1000;
+
+    SafetyHookInline CreateSwapChain_hook{};
+    SafetyHookInline CreateSwapChainForHwnd_hook{};
+    SafetyHookInline Present_hook{};
+    SafetyHookInline ResizeBuffers_hook{};
+
+    bool bLowLatency = false;
+    UINT MaxFrameLatency = 1;
+    bool bAllowTearing = false;
+    bool bTearingSupported = false;
+
+    // The game's swapchain, held so the pointer can't be reused by another, and the flags we added to it.
+    // ResizeBuffers must keep passing them.
+    IDXGISwapChain* Active = nullptr;
+    IDXGISwapChain2* Active2 = nullptr;
+    HANDLE LatencyWaitable = nullptr;
+    UINT AddedFlags = 0;
+    bool bFlipModel = false;
+    ID3D11DeviceContext* Context = nullptr;
+
+    // Runs once per presented frame, just before Present. Everything that needs a frame boundary hangs off this.
+    void (*OnFrame)() = nullptr;
+
+    // Runs with the back buffer size whenever the swapchain is created or resized.
+    void (*OnResize)(UINT width, UINT height) = nullptr;
+
+    bool IsFlipFormat(DXGI_FORMAT format)
+    {
+        return format == DXGI_FORMAT_R8G8B8A8_UNORM || format == DXGI_FORMAT_B8G8R8A8_UNORM ||
+            format == DXGI_FORMAT_R10G10B10A2_UNORM || format == DXGI_FORMAT_R16G16B16A16_FLOAT;
+    }
+
+    struct PresentWindow : Frame::Window
+    {
+        double waitMs = 0.0;
+        double latencyMs = 0.0;
+        uint64_t latencyCount = 0;
+
+        double AverageWait() const { return count ? waitMs / count : 0.0; }
+        double AverageLatency() const { return latencyCount ? latencyMs / latencyCount : 0.0; }
+    };
+
+    // The queue is bounded from the first frame. After MeasurePresents presents, the same swapchain runs as many again
+    // at DXGI's default depth for comparison, then is bounded for good. Only the queue depth is compared: any swap
+    // effect upgrade is in place for both windows.
+    enum class Phase
+    {
+        Bounded,
+        Baseline,
+        Done,
+    };
+    constexpr uint64_t MeasurePresents = 600;
+    PresentWindow Before; // Default depth
+    PresentWindow After;  // Bounded
+    Phase MeasurePhase = Phase::Bounded;
+    int64_t LastPresentTick = 0;
+
+    // Present call times by present count, matched against frame statistics to get present-to-display latency.
+    constexpr size_t PendingSize = 16;
+    std::array<std::pair<UINT, int64_t>, PendingSize> Pending{};
+
+    void ApplyFrameLatency(UINT latency)
+    {
+        if (Active2)
+        {
+            Active2->SetMaximumFrameLatency(latency);
+            return;
+        }
+
+        // Blt-model swapchains have no waitable object, the queue depth lives on the device instead.
+        IDXGIDevice1* device = nullptr;
+        if (SUCCEEDED(Active->GetDevice(__uuidof(IDXGIDevice1), reinterpret_cast<void**>(&device))))
+        {
+            device->SetMaximumFrameLatency(latency);
+            device->Release();
+        }
+    }
+
+    // Flip model unbinds the back buffer from the pipeline on Present, blt model left it bound.
+    // The game never rebinds it, so put back whatever was bound before Present.
+    struct BoundTargets
+    {
+        ID3D11RenderTargetView* views[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
+        ID3D11DepthStencilView* depth = nullptr;
+
+        void Save()
+        {
+            Context->OMGetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, views, &depth);
+        }
+
+        void Restore()
+        {
+            Context->OMSetRenderTargets(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, views, depth);
+            for (auto* view : views)
+            {
+                if (view)
+                {
+                    view->Release();
+                }
+            }
+            if (depth)
+            {
+                depth->Release();
+            }
+        }
+    };
+
+    // Milliseconds spent waiting.
+    double WaitForQueue()
+    {
+        if (!LatencyWaitable)
+        {
+            return 0.0;
+        }
+        int64_t start = Frame::Now();
+        WaitForSingleObjectEx(LatencyWaitable, WaitTimeoutMs, TRUE);
+        return Frame::ToSeconds(Frame::Now() - start) * 1000.0;
+    }
+
+    void Measure(IDXGISwapChain* swapChain, int64_t presentTick, PresentWindow& window)
+    {
+        if (LastPresentTick)
+        {
+            window.Add(Frame::ToSeconds(presentTick - LastPresentTick) * 1000.0);
+        }
+        LastPresentTick = presentTick;
+
+        UINT presentCount = 0;
+        if (FAILED(swapChain->GetLastPresentCount(&presentCount)))
+        {
+            return;
+        }
+        Pending[presentCount % PendingSize] = { presentCount, presentTick };
+
+        DXGI_FRAME_STATISTICS stats{};
+        if (SUCCEEDED(swapChain->GetFrameStatistics(&stats)))
+        {
+            auto& [count, tick] = Pending[stats.PresentCount % PendingSize];
+            if (count == stats.PresentCount && tick && stats.SyncQPCTime.QuadPart > tick)
+            {
+                window.latencyMs += Frame::ToSeconds(stats.SyncQPCTime.QuadPart - tick) * 1000.0;
+                window.latencyCount++;
+                tick = 0;
+            }
+        }
+    }
+
+    void Log()
+    {
+        spdlog::info("Low Latency: Same swapchain (flip model: {}) at DXGI's default frame latency {} -> bounded {}, over {} presents each:",
+            bFlipModel, BaselineFrameLatency, MaxFrameLatency, MeasurePresents);
+        spdlog::info("Low Latency: Present-to-present {:.3f}ms +/- {:.3f}ms -> {:.3f}ms +/- {:.3f}ms, waiting on queue {:.3f}ms -> {:.3f}ms per frame.",
+            Before.mean, Before.StdDev(), After.mean, After.StdDev(), Before.AverageWait(), After.AverageWait());
+        if (Before.latencyCount && After.latencyCount)
+        {
+            spdlog::info("Low Latency: Present-to-display latency {:.3f}ms -> {:.3f}ms.", Before.AverageLatency(), After.AverageLatency());
+        }
+        else
+        {
+            spdlog::info("Low Latency: Present-to-display latency is not available for this swapchain.");
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE Present_hooked(IDXGISwapChain* swapChain, UINT SyncInterval, UINT Flags)
+    {
+        if (swapChain != Active)
+        {
+            return Present_hook.stdcall<HRESULT>(swapChain, SyncInterval, Flags);
+        }
+
+        if (OnFrame && !(Flags & DXGI_PRESENT_TEST))
+        {
+            OnFrame();
+        }
+
+        if (!bLowLatency)
+        {
+            return Present_hook.stdcall<HRESULT>(swapChain, SyncInterval, Flags);
+        }
+
+        // Tearing is only allowed with vsync off and never in exclusive fullscreen.
+        if ((AddedFlags & DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING) && SyncInterval == 0 && !(Flags & DXGI_PRESENT_TEST))
+        {
+            BOOL bFullscreen = FALSE;
+            if (SUCCEEDED(swapChain->GetFullscreenState(&bFullscreen, nullptr)) && !bFullscreen)
+            {
+                Flags |= DXGI_PRESENT_ALLOW_TEARING;
+            }
+        }
+
+        if (Flags & DXGI_PRESENT_TEST)
+        {
+            return Present_hook.stdcall<HRESULT>(swapChain, SyncInterval, Flags);
+        }
+
+        BoundTargets targets;
+        bool bRebind = bFlipModel && Context;
+        if (bRebind)
+        {
+            targets.Save();
+        }
+
+        int64_t presentTick = Frame::Now();
+        HRESULT result = Present_hook.stdcall<HRESULT>(swapChain, SyncInterval, Flags);
+        if (bRebind)
+        {
+            targets.Restore();
+        }
+
+        if (MeasurePhase == Phase::Bounded)
+        {
+            Measure(swapChain, presentTick, After);
+            if (After.count >= MeasurePresents)
+            {
+                ApplyFrameLatency(BaselineFrameLatency);
+                MeasurePhase = Phase::Baseline;
+            }
+        }
+        else if (MeasurePhase == Phase::Baseline)
+        {
+            Measure(swapChain, presentTick, Before);
+            if (Before.count >= MeasurePresents)
+            {
+                ApplyFrameLatency(MaxFrameLatency);
+                MeasurePhase = Phase::Done;
+                Log();
+            }
+        }
+
+        // Block until the queue has room before the game starts CPU work on the next frame.
+        if (MeasurePhase != Phase::Baseline)
+        {
+            double waitMs = WaitForQueue();
+            if (MeasurePhase == Phase::Bounded)
+            {
+                After.waitMs += waitMs;
+            }
+        }
+        return result;
+    }
+
+    // Width and height of 0 take the window's size, so the real size comes from the swapchain.
+    void NotifyResize(IDXGISwapChain* swapChain)
+    {
+        DXGI_SWAP_CHAIN_DESC desc{};
+        if (OnResize && SUCCEEDED(swapChain->GetDesc(&desc)))
+        {
+            OnResize(desc.BufferDesc.Width, desc.BufferDesc.Height);
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE ResizeBuffers_hooked(IDXGISwapChain* swapChain, UINT BufferCount, UINT Width, UINT Height, DXGI_FORMAT NewFormat, UINT SwapChainFlags)
+    {
+        if (swapChain == Active)
+        {
+            SwapChainFlags |= AddedFlags;
+            if (bFlipModel && BufferCount == 1)
+            {
+                BufferCount = 2;
+            }
+        }
+        HRESULT result = ResizeBuffers_hook.stdcall<HRESULT>(swapChain, BufferCount, Width, Height, NewFormat, SwapChainFlags);
+        if (SUCCEEDED(result) && swapChain == Active)
+        {
+            NotifyResize(swapChain);
+        }
+        return result;
+    }
+
+    void HookSwapChain(IDXGISwapChain* swapChain)
+    {
+        if (Present_hook)
+        {
+            return;
+        }
+
+        void** vtable = *reinterpret_cast<void***>(swapChain);
+        Present_hook = Hooks::CreateInline(vtable[PresentIndex], reinterpret_cast<void*>(Present_hooked));
+        ResizeBuffers_hook = Hooks::CreateInline(vtable[ResizeBuffersIndex], reinterpret_cast<void*>(ResizeBuffers_hooked));
+        spdlog::info("Swapchain: Hooked Present: {}, ResizeBuffers: {}", (bool)Present_hook, (bool)ResizeBuffers_hook);
+    }
+
+    void Track(IDXGISwapChain* swapChain, UINT addedFlags, bool bFlip)
+    {
+        if (Active2)
+        {
+            Active2->Release();
+            Active2 = nullptr;
+        }
+        if (LatencyWaitable)
+        {
+            CloseHandle(LatencyWaitable);
+            LatencyWaitable = nullptr;
+        }
+        if (Context)
+        {
+            Context->Release();
+            Context = nullptr;
+        }
+
+        if (Active)
+        {
+            Active->Release();
+        }
+        Active = swapChain;
+        Active->AddRef();
+        AddedFlags = addedFlags;
+        bFlipModel = bFlip;
+        MeasurePhase = Phase::Bounded;
+        Before = {};
+        After = {};
+        LastPresentTick = 0;
+
+        if ((addedFlags & DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) &&
+            SUCCEEDED(swapChain->QueryInterface(__uuidof(IDXGISwapChain2), reinterpret_cast<void**>(&Active2))))
+        {
+            LatencyWaitable = Active2->GetFrameLatencyWaitableObject();
+        }
+
+        ID3D11Device* d3dDevice = nullptr;
+        if (bFlip && SUCCEEDED(swapChain->GetDevice(__uuidof(ID3D11Device), reinterpret_cast<void**>(&d3dDevice))))
+        {
+            d3dDevice->GetImmediateContext(&Context);
+            d3dDevice->Release();
+        }
+
+        if (bLowLatency)
+        {
+            ApplyFrameLatency(MaxFrameLatency);
+        }
+        HookSwapChain(swapChain);
+        NotifyResize(swapChain);
+    }
+
+    // Set while CreateSwapChain runs, in case DXGI implements it on top of CreateSwapChainForHwnd.
+    thread_local bool bInCreateSwapChain = false;
+
+    HRESULT STDMETHODCALLTYPE CreateSwapChain_hooked(IDXGIFactory* factory, IUnknown* device, DXGI_SWAP_CHAIN_DESC* desc, IDXGISwapChain** swapChain)
+    {
+        if (!desc || !swapChain)
+        {
+            return CreateSwapChain_hook.stdcall<HRESULT>(factory, device, desc, swapChain);
+        }
+
+        bInCreateSwapChain = true;
+        struct Reset { ~Reset() { bInCreateSwapChain = false; } } reset;
+
+        // Only tracked for frame timing, leave the swapchain as the game asked for it.
+        if (!bLowLatency)
+        {
+            HRESULT result = CreateSwapChain_hook.stdcall<HRESULT>(factory, device, desc, swapChain);
+            if (SUCCEEDED(result))
+            {
+                Track(*swapChain, 0, false);
+            }
+            return result;
+        }
+
+        // Flip model needs a single-sampled, non-sRGB back buffer. Leave exclusive fullscreen swapchains alone.
+        DXGI_SWAP_CHAIN_DESC upgraded = *desc;
+        bool bFlip = desc->Windowed && desc->SampleDesc.Count == 1 && IsFlipFormat(desc->BufferDesc.Format);
+        UINT addedFlags = 0;
+        if (bFlip)
+        {
+            upgraded.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+            upgraded.BufferCount = std::max(desc->BufferCount, 2u);
+            addedFlags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+            if (bAllowTearing && bTearingSupported)
+            {
+                addedFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+            }
+            upgraded.Flags |= addedFlags;
+        }
+        else
+        {
+            spdlog::info("Low Latency: Keeping original swapchain (windowed: {}, samples: {}, format: {}).", (bool)desc->Windowed, desc->SampleDesc.Count, (int)desc->BufferDesc.Format);
+        }
+
+        HRESULT result = CreateSwapChain_hook.stdcall<HRESULT>(factory, device, &upgraded, swapChain);
+        if (FAILED(result) && bFlip)
+        {
+            spdlog::error("Low Latency: Flip model swapchain creation failed ({:#x}), falling back to the original.", (uint32_t)result);
+            bFlip = false;
+            addedFlags = 0;
+            result = CreateSwapChain_hook.stdcall<HRESULT>(factory, device, desc, swapChain);
+        }
+
+        if (SUCCEEDED(result))
+        {
+            spdlog::info("Low Latency: Created {}x{} swapchain. Flip model: {}, tearing: {}, waitable: {}.", desc->BufferDesc.Width, desc->BufferDesc.Height, bFlip,
+                (addedFlags & DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING) != 0, (addedFlags & DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) != 0);
+            Track(*swapChain, addedFlags, bFlip);
+        }
+        return result;
+    }
+
+    // The game uses CreateSwapChain, this is only in case something creates its swapchain the newer way.
+    // Its description isn't upgraded, but it is tracked for frame timing and its queue is still bounded through the device.
+    HRESULT STDMETHODCALLTYPE CreateSwapChainForHwnd_hooked(IDXGIFactory2* factory, IUnknown* device, HWND hWnd, const DXGI_SWAP_CHAIN_DESC1* desc,
+        const DXGI_SWAP_CHAIN_FULLSCREEN_DESC* fullscreenDesc, IDXGIOutput* output, IDXGISwapChain1** swapChain)
+    {
+        HRESULT result = CreateSwapChainForHwnd_hook.stdcall<HRESULT>(factory, device, hWnd, desc, fullscreenDesc, output, swapChain);
+        if (SUCCEEDED(result) && swapChain && !bInCreateSwapChain)
+        {
+            if (bLowLatency)
+            {
+                spdlog::info("Low Latency: Swapchain was created with CreateSwapChainForHwnd, keeping its own swap effect and flags.");
+            }
+            Track(*swapChain, 0, false);
+        }
+        return result;
+    }
+
+    // Hooks IDXGIFactory::CreateSwapChain, and CreateSwapChainForHwnd where the factory has it. D3D11CreateDeviceAndSwapChain
+    // goes through the same implementation. Without lowLatency the swapchain is only tracked so Present can drive OnFrame.
+    bool Init(bool lowLatency, int maxFrameLatency, bool allowTearing)
+    {
+        bLowLatency = lowLatency;
+        MaxFrameLatency = (UINT)std::clamp(maxFrameLatency, 1, 16);
+        bAllowTearing = allowTearing;
+
+        HMODULE dxgi = LoadLibraryW(L"dxgi.dll");
+        auto CreateDXGIFactory1 = dxgi ? reinterpret_cast<CreateDXGIFactory1_t>(GetProcAddress(dxgi, "CreateDXGIFactory1")) : nullptr;
+        IDXGIFactory1* factory = nullptr;
+        if (!CreateDXGIFactory1 || FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), reinterpret_cast<void**>(&factory))))
+        {
+            return false;
+        }
+
+        IDXGIFactory5* factory5 = nullptr;
+        if (SUCCEEDED(factory->QueryInterface(__uuidof(IDXGIFactory5), reinterpret_cast<void**>(&factory5))))
+        {
+            BOOL bSupported = FALSE;
+            bTearingSupported = SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &bSupported, sizeof(bSupported))) && bSupported;
+            factory5->Release();
+        }
+
+        void** vtable = *reinterpret_cast<void***>(factory);
+        CreateSwapChain_hook = Hooks::CreateInline(vtable[CreateSwapChainIndex], reinterpret_cast<void*>(CreateSwapChain_hooked));
+
+        IDXGIFactory2* factory2 = nullptr;
+        if (SUCCEEDED(factory->QueryInterface(__uuidof(IDXGIFactory2), reinterpret_cast<void**>(&factory2))))
+        {
+            void** vtable2 = *reinterpret_cast<void***>(factory2);
+            CreateSwapChainForHwnd_hook = Hooks::CreateInline(vtable2[CreateSwapChainForHwndIndex], reinterpret_cast<void*>(CreateSwapChainForHwnd_hooked));
+            factory2->Release();
+        }
+        factory->Release();
+        return (bool)CreateSwapChain_hook;
+    }
+}
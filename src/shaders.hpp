@@ -0,0 +1,641 @@
+#pragma once
+
+#include "stdafx.h"
+#include "frame.hpp"
+#include "hooks.hpp"
+#include <spdlog/spdlog.h>
+
+namespace Shaders
+{
+    // Objects are keyed by kind and a hash of what the game passed to the device. Signatures are the
+    // bytecode input layouts are validated against, stored separately so layouts can be recreated.
+    // The order matters: prewarm creates everything in key order, so signatures come before layouts.
+    enum Kind : uint8_t
+    {
+        VertexShader,
+        GeometryShader,
+        PixelShader,
+        HullShader,
+        DomainShader,
+        ComputeShader,
+        Signature,
+        InputLayout,
+        BlendState,
+        DepthStencilState,
+        RasterizerState,
+        SamplerState,
+        KindCount
+    };
+
+    constexpr std::array<const char*, KindCount> KindNames = {
+        "vertex shaders", "geometry shaders", "pixel shaders", "hull shaders", "domain shaders", "compute shaders",
+        "signatures", "input layouts", "blend states", "depth stencil states", "rasterizer states", "sampler states" };
+
+    // ID3D11Device vtable slots
+    constexpr std::array<size_t, KindCount> VtableIndex = { 12, 13, 15, 16, 17, 18, 0, 11, 20, 21, 22, 23 };
+
+    // Manifest file: header, then { kind, hash, size, payload } records.
+    constexpr uint32_t Magic = 0x53344F53; // "SO4S"
+    constexpr uint32_t Version = 1;
+    constexpr uint32_t MaxPayloadSize = 16 * 1024 * 1024; // Far past any shader, caps what a corrupt size can allocate.
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t baselineHitches; // Hitches on the run that first recorded the manifest, without prewarm.
+        uint32_t count;
+    };
+
+    using Key = std::pair<uint8_t, uint64_t>;
+    using Objects = std::map<Key, std::vector<uint8_t>>;
+
+    // Creation calls on the game's threads that stall for longer than this in one frame count as a hitch.
+    constexpr double HitchMs = 8.0;
+    constexpr double BurstGapSeconds = 0.016;
+
+    // New objects are written out this often, so little is left to save when the process exits.
+    constexpr auto SaveInterval = std::chrono::seconds(10);
+
+    using D3D11CreateDevice_t = HRESULT(WINAPI*)(IDXGIAdapter*, D3D_DRIVER_TYPE, HMODULE, UINT, const D3D_FEATURE_LEVEL*, UINT, UINT,
+        ID3D11Device**, D3D_FEATURE_LEVEL*, ID3D11DeviceContext**);
+    using D3D11CreateDeviceAndSwapChain_t = HRESULT(WINAPI*)(IDXGIAdapter*, D3D_DRIVER_TYPE, HMODULE, UINT, const D3D_FEATURE_LEVEL*, UINT, UINT,
+        const DXGI_SWAP_CHAIN_DESC*, IDXGISwapChain**, ID3D11Device**, D3D_FEATURE_LEVEL*, ID3D11DeviceContext**);
+
+    SafetyHookInline D3D11CreateDevice_hook{};
+    SafetyHookInline D3D11CreateDeviceAndSwapChain_hook{};
+    std::array<SafetyHookInline, KindCount> Create_hooks{};
+
+    std::filesystem::path ManifestPath;
+    uint32_t BaselineHitches = 0;
+    bool bHaveManifest = false;
+
+    std::atomic<ID3D11Device*> Device = nullptr; // The device the game creates its objects on.
+    std::mutex Mutex;
+    Objects Manifest;   // Loaded at startup, read-only once the prewarm thread is running.
+    Objects Recorded;   // Created this run and not in the manifest yet.
+    size_t SavedCount = 0; // How many of Recorded the manifest file already holds.
+    std::vector<ID3D11DeviceChild*> Warm; // Held so the runtime and driver keep them around.
+    std::thread PrewarmThread;
+    thread_local bool bPrewarming = false;
+
+    // Stats for creation calls made by the game.
+    std::array<uint64_t, KindCount> Created{};
+    uint64_t Prewarmed = 0;
+    uint64_t Hitches = 0;
+    double CreateMs = 0.0;
+    double WorstBurstMs = 0.0;
+    uint64_t BurstFrame = 0;
+    int64_t BurstEnd = 0;
+    double BurstMs = 0.0;
+
+    uint64_t Hash(const void* data, size_t size, uint64_t hash = 0xCBF29CE484222325ull)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    template<typename T>
+    void Append(std::vector<uint8_t>& out, const T& value)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<typename T>
+    bool Read(const std::vector<uint8_t>& in, size_t& offset, T& value)
+    {
+        if (offset + sizeof(T) > in.size())
+        {
+            return false;
+        }
+        memcpy(&value, in.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    // Must be called with Mutex held.
+    void CloseBurst()
+    {
+        if (BurstMs >= HitchMs)
+        {
+            Hitches++;
+        }
+        WorstBurstMs = std::max(WorstBurstMs, BurstMs);
+        BurstMs = 0.0;
+    }
+
+    // Adds a creation call to the current burst. Calls in the same frame, or close together when
+    // frames aren't being counted, are one stall as far as the player is concerned.
+    void AddCreation(int64_t start, int64_t end)
+    {
+        std::scoped_lock lock{ Mutex };
+        if (Frame::FrameCount != BurstFrame || Frame::ToSeconds(start - BurstEnd) > BurstGapSeconds)
+        {
+            CloseBurst();
+            BurstFrame = Frame::FrameCount;
+        }
+
+        double ms = Frame::ToSeconds(end - start) * 1000.0;
+        BurstMs += ms;
+        CreateMs += ms;
+        BurstEnd = end;
+    }
+
+    void Record(Kind kind, std::vector<uint8_t>&& payload, uint64_t hash)
+    {
+        std::scoped_lock lock{ Mutex };
+        Key key{ kind, hash };
+        bool bKnown = Manifest.count(key) != 0;
+        if (kind != Signature)
+        {
+            Created[kind]++;
+            Prewarmed += bKnown;
+        }
+        if (!bKnown)
+        {
+            Recorded.try_emplace(key, std::move(payload));
+        }
+    }
+
+    void Record(Kind kind, const void* data, size_t size)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(data);
+        Record(kind, std::vector<uint8_t>(bytes, bytes + size), Hash(data, size));
+    }
+
+    // Layout payload: signature hash, element count, then each element with its semantic name inline.
+    std::vector<uint8_t> SerializeLayout(const D3D11_INPUT_ELEMENT_DESC* elements, UINT count, uint64_t signature)
+    {
+        std::vector<uint8_t> out;
+        Append(out, signature);
+        Append(out, count);
+        for (UINT i = 0; i < count; i++)
+        {
+            const auto& element = elements[i];
+            uint32_t nameLength = (uint32_t)strlen(element.SemanticName);
+            Append(out, nameLength);
+            out.insert(out.end(), element.SemanticName, element.SemanticName + nameLength);
+            Append(out, element.SemanticIndex);
+            Append(out, element.Format);
+            Append(out, element.InputSlot);
+            Append(out, element.AlignedByteOffset);
+            Append(out, element.InputSlotClass);
+            Append(out, element.InstanceDataStepRate);
+        }
+        return out;
+    }
+
+    void Prewarm();
+    void SaveWorker();
+
+    // The first device the game creates objects on is the one to record and prewarm for. Devices created
+    // only to probe for features never get that far.
+    void Adopt(ID3D11Device* device)
+    {
+        if (Device)
+        {
+            return;
+        }
+
+        std::scoped_lock lock{ Mutex };
+        if (!Device)
+        {
+            device->AddRef();
+            Device = device;
+            std::thread(SaveWorker).detach();
+
+            // A single threaded device must not be called from any other thread, so it can only be recorded.
+            if (device->GetCreationFlags() & D3D11_CREATE_DEVICE_SINGLETHREADED)
+            {
+                spdlog::info("Shader Prewarm: Device was created single threaded, skipping prewarm.");
+            }
+            else if (!Manifest.empty())
+            {
+                PrewarmThread = std::thread(Prewarm);
+            }
+        }
+    }
+
+    template<Kind K, typename T>
+    HRESULT STDMETHODCALLTYPE CreateShader_hooked(ID3D11Device* device, const void* bytecode, SIZE_T length, ID3D11ClassLinkage* linkage, T** shader)
+    {
+        if (bPrewarming)
+        {
+            return Create_hooks[K].stdcall<HRESULT>(device, bytecode, length, linkage, shader);
+        }
+
+        Adopt(device);
+        int64_t start = Frame::Now();
+        HRESULT result = Create_hooks[K].stdcall<HRESULT>(device, bytecode, length, linkage, shader);
+        AddCreation(start, Frame::Now());
+
+        // Shaders using class linkage can't be recreated without the game's linkage object.
+        if (SUCCEEDED(result) && shader && !linkage && device == Device)
+        {
+            Record(K, bytecode, length);
+        }
+        return result;
+    }
+
+    template<Kind K, typename Desc, typename T>
+    HRESULT STDMETHODCALLTYPE CreateState_hooked(ID3D11Device* device, const Desc* desc, T** state)
+    {
+        if (bPrewarming)
+        {
+            return Create_hooks[K].stdcall<HRESULT>(device, desc, state);
+        }
+
+        Adopt(device);
+        int64_t start = Frame::Now();
+        HRESULT result = Create_hooks[K].stdcall<HRESULT>(device, desc, state);
+        AddCreation(start, Frame::Now());
+
+        if (SUCCEEDED(result) && desc && state && device == Device)
+        {
+            Record(K, desc, sizeof(Desc));
+        }
+        return result;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateInputLayout_hooked(ID3D11Device* device, const D3D11_INPUT_ELEMENT_DESC* elements, UINT count,
+        const void* bytecode, SIZE_T length, ID3D11InputLayout** layout)
+    {
+        if (bPrewarming)
+        {
+            return Create_hooks[InputLayout].stdcall<HRESULT>(device, elements, count, bytecode, length, layout);
+        }
+
+        Adopt(device);
+        int64_t start = Frame::Now();
+        HRESULT result = Create_hooks[InputLayout].stdcall<HRESULT>(device, elements, count, bytecode, length, layout);
+        AddCreation(start, Frame::Now());
+
+        if (SUCCEEDED(result) && layout && device == Device)
+        {
+            uint64_t signature = Hash(bytecode, length);
+            auto payload = SerializeLayout(elements, count, signature);
+            uint64_t hash = Hash(payload.data(), payload.size());
+            Record(Signature, bytecode, length);
+            Record(InputLayout, std::move(payload), hash);
+        }
+        return result;
+    }
+
+    ID3D11DeviceChild* CreateLayout(ID3D11Device* device, const std::vector<uint8_t>& payload)
+    {
+        size_t offset = 0;
+        uint64_t signature = 0;
+        uint32_t count = 0;
+        if (!Read(payload, offset, signature) || !Read(payload, offset, count))
+        {
+            return nullptr;
+        }
+
+        auto blob = Manifest.find({ Signature, signature });
+        if (blob == Manifest.end())
+        {
+            return nullptr;
+        }
+
+        std::vector<std::string> names(count);
+        std::vector<D3D11_INPUT_ELEMENT_DESC> elements(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t nameLength = 0;
+            if (!Read(payload, offset, nameLength) || offset + nameLength > payload.size())
+            {
+                return nullptr;
+            }
+            names[i].assign(reinterpret_cast<const char*>(payload.data() + offset), nameLength);
+            offset += nameLength;
+
+            auto& element = elements[i];
+            if (!Read(payload, offset, element.SemanticIndex) || !Read(payload, offset, element.Format) || !Read(payload, offset, element.InputSlot) ||
+                !Read(payload, offset, element.AlignedByteOffset) || !Read(payload, offset, element.InputSlotClass) || !Read(payload, offset, element.InstanceDataStepRate))
+            {
+                return nullptr;
+            }
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            elements[i].SemanticName = names[i].c_str();
+        }
+
+        ID3D11InputLayout* layout = nullptr;
+        device->CreateInputLayout(elements.data(), count, blob->second.data(), blob->second.size(), &layout);
+        return layout;
+    }
+
+    template<typename T, typename Create>
+    ID3D11DeviceChild* CreateWith(Create create)
+    {
+        T* object = nullptr;
+        create(&object);
+        return object;
+    }
+
+    template<typename T, typename Desc, typename Create>
+    ID3D11DeviceChild* CreateState(const std::vector<uint8_t>& payload, Create create)
+    {
+        T* object = nullptr;
+        if (payload.size() == sizeof(Desc))
+        {
+            create(reinterpret_cast<const Desc*>(payload.data()), &object);
+        }
+        return object;
+    }
+
+    ID3D11DeviceChild* Create(ID3D11Device* device, Kind kind, const std::vector<uint8_t>& payload)
+    {
+        const void* data = payload.data();
+        size_t size = payload.size();
+        switch (kind)
+        {
+        case VertexShader:
+            return CreateWith<ID3D11VertexShader>([&](auto out) { return device->CreateVertexShader(data, size, nullptr, out); });
+        case GeometryShader:
+            return CreateWith<ID3D11GeometryShader>([&](auto out) { return device->CreateGeometryShader(data, size, nullptr, out); });
+        case PixelShader:
+            return CreateWith<ID3D11PixelShader>([&](auto out) { return device->CreatePixelShader(data, size, nullptr, out); });
+        case HullShader:
+            return CreateWith<ID3D11HullShader>([&](auto out) { return device->CreateHullShader(data, size, nullptr, out); });
+        case DomainShader:
+            return CreateWith<ID3D11DomainShader>([&](auto out) { return device->CreateDomainShader(data, size, nullptr, out); });
+        case ComputeShader:
+            return CreateWith<ID3D11ComputeShader>([&](auto out) { return device->CreateComputeShader(data, size, nullptr, out); });
+        case InputLayout:
+            return CreateLayout(device, payload);
+        case BlendState:
+            return CreateState<ID3D11BlendState, D3D11_BLEND_DESC>(payload, [&](auto desc, auto out) { return device->CreateBlendState(desc, out); });
+        case DepthStencilState:
+            return CreateState<ID3D11DepthStencilState, D3D11_DEPTH_STENCIL_DESC>(payload, [&](auto desc, auto out) { return device->CreateDepthStencilState(desc, out); });
+        case RasterizerState:
+            return CreateState<ID3D11RasterizerState, D3D11_RASTERIZER_DESC>(payload, [&](auto desc, auto out) { return device->CreateRasterizerState(desc, out); });
+        case SamplerState:
+            return CreateState<ID3D11SamplerState, D3D11_SAMPLER_DESC>(payload, [&](auto desc, auto out) { return device->CreateSamplerState(desc, out); });
+        default:
+            return nullptr;
+        }
+    }
+
+    // Creates everything in the manifest on the game's device. D3D11 devices are free-threaded, so this
+    // runs alongside the intro without touching the immediate context.
+    void Prewarm()
+    {
+        bPrewarming = true;
+        ID3D11Device* device = Device;
+        int64_t start = Frame::Now();
+        std::array<uint64_t, KindCount> counts{};
+        uint64_t failed = 0;
+        for (const auto& [key, payload] : Manifest)
+        {
+            Kind kind = (Kind)key.first;
+            if (kind == Signature)
+            {
+                continue;
+            }
+
+            if (ID3D11DeviceChild* object = Create(device, kind, payload))
+            {
+                Warm.push_back(object);
+                counts[kind]++;
+            }
+            else
+            {
+                failed++;
+            }
+        }
+
+        spdlog::info("Shader Prewarm: Prewarmed {} objects in {:.0f}ms ({} failed).", Warm.size(), Frame::ToSeconds(Frame::Now() - start) * 1000.0, failed);
+        for (size_t kind = 0; kind < KindCount; kind++)
+        {
+            if (counts[kind])
+            {
+                spdlog::info("Shader Prewarm: {} {}", counts[kind], KindNames[kind]);
+            }
+        }
+    }
+
+    void HookDevice(ID3D11Device* device)
+    {
+        if (Create_hooks[VertexShader] || !device)
+        {
+            return;
+        }
+
+        void** vtable = *reinterpret_cast<void***>(device);
+        auto hook = [&](Kind kind, auto function)
+            {
+                Create_hooks[kind] = Hooks::CreateInline(vtable[VtableIndex[kind]], reinterpret_cast<void*>(function));
+            };
+        hook(VertexShader, CreateShader_hooked<VertexShader, ID3D11VertexShader>);
+        hook(GeometryShader, CreateShader_hooked<GeometryShader, ID3D11GeometryShader>);
+        hook(PixelShader, CreateShader_hooked<PixelShader, ID3D11PixelShader>);
+        hook(HullShader, CreateShader_hooked<HullShader, ID3D11HullShader>);
+        hook(DomainShader, CreateShader_hooked<DomainShader, ID3D11DomainShader>);
+        hook(ComputeShader, CreateShader_hooked<ComputeShader, ID3D11ComputeShader>);
+        hook(InputLayout, CreateInputLayout_hooked);
+        hook(BlendState, CreateState_hooked<BlendState, D3D11_BLEND_DESC, ID3D11BlendState>);
+        hook(DepthStencilState, CreateState_hooked<DepthStencilState, D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>);
+        hook(RasterizerState, CreateState_hooked<RasterizerState, D3D11_RASTERIZER_DESC, ID3D11RasterizerState>);
+        hook(SamplerState, CreateState_hooked<SamplerState, D3D11_SAMPLER_DESC, ID3D11SamplerState>);
+
+        size_t hooked = std::count_if(Create_hooks.begin(), Create_hooks.end(), [](const SafetyHookInline& h) { return (bool)h; });
+        spdlog::info("Shader Prewarm: Hooked {} device creation functions.", hooked);
+    }
+
+    HRESULT WINAPI D3D11CreateDevice_hooked(IDXGIAdapter* pAdapter, D3D_DRIVER_TYPE DriverType, HMODULE Software, UINT Flags, const D3D_FEATURE_LEVEL* pFeatureLevels,
+        UINT FeatureLevels, UINT SDKVersion, ID3D11Device** ppDevice, D3D_FEATURE_LEVEL* pFeatureLevel, ID3D11DeviceContext** ppImmediateContext)
+    {
+        HRESULT result = D3D11CreateDevice_hook.stdcall<HRESULT>(pAdapter, DriverType, Software, Flags, pFeatureLevels, FeatureLevels, SDKVersion, ppDevice, pFeatureLevel, ppImmediateContext);
+        if (SUCCEEDED(result) && ppDevice)
+        {
+            HookDevice(*ppDevice);
+        }
+        return result;
+    }
+
+    HRESULT WINAPI D3D11CreateDeviceAndSwapChain_hooked(IDXGIAdapter* pAdapter, D3D_DRIVER_TYPE DriverType, HMODULE Software, UINT Flags, const D3D_FEATURE_LEVEL* pFeatureLevels,
+        UINT FeatureLevels, UINT SDKVersion, const DXGI_SWAP_CHAIN_DESC* pSwapChainDesc, IDXGISwapChain** ppSwapChain, ID3D11Device** ppDevice,
+        D3D_FEATURE_LEVEL* pFeatureLevel, ID3D11DeviceContext** ppImmediateContext)
+    {
+        HRESULT result = D3D11CreateDeviceAndSwapChain_hook.stdcall<HRESULT>(pAdapter, DriverType, Software, Flags, pFeatureLevels, FeatureLevels, SDKVersion,
+            pSwapChainDesc, ppSwapChain, ppDevice, pFeatureLevel, ppImmediateContext);
+        if (SUCCEEDED(result) && ppDevice)
+        {
+            HookDevice(*ppDevice);
+        }
+        return result;
+    }
+
+    void LoadManifest()
+    {
+        std::ifstream file(ManifestPath, std::ios::binary);
+        Header header{};
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != Magic || header.version != Version)
+        {
+            return;
+        }
+
+        for (uint32_t i = 0; i < header.count; i++)
+        {
+            uint8_t kind = 0;
+            uint64_t hash = 0;
+            uint32_t size = 0;
+            file.read(reinterpret_cast<char*>(&kind), sizeof(kind));
+            file.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+            file.read(reinterpret_cast<char*>(&size), sizeof(size));
+            if (!file || kind >= KindCount || size > MaxPayloadSize)
+            {
+                spdlog::error("Shader Prewarm: Manifest is truncated or corrupt, ignoring it.");
+                Manifest.clear();
+                return;
+            }
+
+            std::vector<uint8_t> payload(size);
+            if (!file.read(reinterpret_cast<char*>(payload.data()), size))
+            {
+                spdlog::error("Shader Prewarm: Manifest is truncated or corrupt, ignoring it.");
+                Manifest.clear();
+                return;
+            }
+            Manifest.emplace(Key{ kind, hash }, std::move(payload));
+        }
+
+        bHaveManifest = true;
+        BaselineHitches = header.baselineHitches;
+        spdlog::info("Shader Prewarm: Loaded {} objects from manifest.", Manifest.size());
+    }
+
+    // Manifest is read-only after startup, so only the recorded objects need to be a stable copy.
+    // Written to a temporary file and renamed over the manifest, so a failed or interrupted save leaves the old one intact.
+    bool SaveManifest(const Objects& recorded, uint32_t baselineHitches)
+    {
+        auto tempPath = std::filesystem::path(ManifestPath).concat(L".tmp");
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        Header header{ Magic, Version, baselineHitches, (uint32_t)(Manifest.size() + recorded.size()) };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const Objects* objects : { &Manifest, &recorded })
+        {
+            for (const auto& [key, payload] : *objects)
+            {
+                uint32_t size = (uint32_t)payload.size();
+                file.write(reinterpret_cast<const char*>(&key.first), sizeof(key.first));
+                file.write(reinterpret_cast<const char*>(&key.second), sizeof(key.second));
+                file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                file.write(reinterpret_cast<const char*>(payload.data()), size);
+            }
+        }
+
+        file.close();
+        std::error_code ec;
+        if (!file.fail())
+        {
+            std::filesystem::rename(tempPath, ManifestPath, ec);
+        }
+        if (file.fail() || ec)
+        {
+            spdlog::error("Shader Prewarm: Failed to save manifest {}.", ManifestPath.string());
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+        return true;
+    }
+
+    void SaveWorker()
+    {
+        while (true)
+        {
+            std::this_thread::sleep_for(SaveInterval);
+
+            Objects recorded;
+            uint32_t baselineHitches = 0;
+            {
+                std::scoped_lock lock{ Mutex };
+                if (Recorded.size() == SavedCount)
+                {
+                    continue;
+                }
+                recorded = Recorded;
+                baselineHitches = bHaveManifest ? BaselineHitches : (uint32_t)Hitches;
+            }
+
+            // Recorded only grows, so the copy's size is how many of its objects the file now holds. A failed save is retried next pass.
+            if (SaveManifest(recorded, baselineHitches))
+            {
+                std::scoped_lock lock{ Mutex };
+                SavedCount = recorded.size();
+            }
+        }
+    }
+
+    bool Init(const std::filesystem::path& manifestPath)
+    {
+        ManifestPath = manifestPath;
+        LoadManifest();
+
+        HMODULE d3d11 = LoadLibraryW(L"d3d11.dll");
+        if (!d3d11)
+        {
+            return false;
+        }
+
+        auto createDevice = GetProcAddress(d3d11, "D3D11CreateDevice");
+        auto createDeviceAndSwapChain = GetProcAddress(d3d11, "D3D11CreateDeviceAndSwapChain");
+        if (createDevice)
+        {
+            D3D11CreateDevice_hook = Hooks::CreateInline(reinterpret_cast<void*>(createDevice), reinterpret_cast<void*>(D3D11CreateDevice_hooked));
+        }
+        if (createDeviceAndSwapChain)
+        {
+            D3D11CreateDeviceAndSwapChain_hook = Hooks::CreateInline(reinterpret_cast<void*>(createDeviceAndSwapChain), reinterpret_cast<void*>(D3D11CreateDeviceAndSwapChain_hooked));
+        }
+        return D3D11CreateDevice_hook || D3D11CreateDeviceAndSwapChain_hook;
+    }
+
+    // Runs at process detach. The other threads are already gone and may have died holding Mutex,
+    // in which case the manifest is left as the save worker last wrote it.
+    void Shutdown()
+    {
+        // The process is going away, the thread can't be joined from DllMain.
+        if (PrewarmThread.joinable())
+        {
+            PrewarmThread.detach();
+        }
+
+        std::unique_lock lock{ Mutex, std::try_to_lock };
+        if (!lock)
+        {
+            return;
+        }
+        CloseBurst();
+
+        uint64_t created = 0;
+        for (size_t kind = 0; kind < KindCount; kind++)
+        {
+            created += kind == Signature ? 0 : Created[kind];
+        }
+        spdlog::info("Shader Prewarm: Game created {} objects ({} prewarmed, {} new) taking {:.0f}ms, worst stall {:.1f}ms.",
+            created, Prewarmed, Recorded.size(), CreateMs, WorstBurstMs);
+
+        if (bHaveManifest)
+        {
+            spdlog::info("Shader Prewarm: {} hitches over {:.0f}ms this run, {} on the run that recorded the manifest.", Hitches, HitchMs, BaselineHitches);
+        }
+        else
+        {
+            BaselineHitches = (uint32_t)Hitches;
+            spdlog::info("Shader Prewarm: {} hitches over {:.0f}ms this run. Recorded as the baseline for later runs.", Hitches, HitchMs);
+        }
+
+        if (Recorded.size() != SavedCount || !bHaveManifest)
+        {
+            SaveManifest(Recorded, BaselineHitches);
+        }
+    }
+}
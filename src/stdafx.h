@@ -1,8 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
 #include <fstream>
 #include <string>
 #include <filesystem>
-#include <Windows.h>
\ No newline at end of file
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#define NOMINMAX
+#include <Windows.h>
+#include <d3d11.h>
+#include <dxgi1_6.h>
\ No newline at end of file
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "stdafx.h"
+#include "frame.hpp"
+#include <spdlog/spdlog.h>
+#include <TlHelp32.h>
+
+namespace Threads
+{
+    enum class PlacementMode : int
+    {
+        None = 0,
+        CpuSets = 1,
+        Affinity = 2,
+    };
+
+    // Preferred cores: highest efficiency class, then the last level cache (CCD) with the most of them.
+    std::vector<ULONG> PreferredCpuSets;
+    KAFFINITY PreferredAffinity = 0;
+    bool bUniformTopology = true;
+
+    using NtQueryInformationThread_t = LONG(NTAPI*)(HANDLE, ULONG, PVOID, ULONG, PULONG);
+    constexpr ULONG ThreadQuerySetWin32StartAddress = 9;
+
+    uintptr_t GetStartAddress(HANDLE thread)
+    {
+        static auto NtQueryInformationThread = reinterpret_cast<NtQueryInformationThread_t>(GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtQueryInformationThread"));
+        uintptr_t startAddress = 0;
+        if (NtQueryInformationThread)
+        {
+            NtQueryInformationThread(thread, ThreadQuerySetWin32StartAddress, &startAddress, sizeof(startAddress), nullptr);
+        }
+        return startAddress;
+    }
+
+    // Only the main thread is found this way, once at startup, so a thread snapshot is enough and threads aren't tracked as they attach.
+    // The render thread is whichever thread drives the frames; it is placed from OnFrame.
+    DWORD FindByStartAddress(uintptr_t startAddress)
+    {
+        HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+        if (snapshot == INVALID_HANDLE_VALUE)
+        {
+            return 0;
+        }
+
+        DWORD id = 0;
+        THREADENTRY32 entry{ .dwSize = sizeof(THREADENTRY32) };
+        for (BOOL ok = Thread32First(snapshot, &entry); ok && !id; ok = Thread32Next(snapshot, &entry))
+        {
+            if (entry.th32OwnerProcessID != GetCurrentProcessId())
+            {
+                continue;
+            }
+
+            if (HANDLE thread = OpenThread(THREAD_QUERY_INFORMATION, FALSE, entry.th32ThreadID))
+            {
+                if (GetStartAddress(thread) == startAddress)
+                {
+                    id = entry.th32ThreadID;
+                }
+                CloseHandle(thread);
+            }
+        }
+        CloseHandle(snapshot);
+        return id;
+    }
+
+    void DetectTopology()
+    {
+        ULONG length = 0;
+        GetSystemCpuSetInformation(nullptr, 0, &length, GetCurrentProcess(), 0);
+        std::vector<uint8_t> buffer(length);
+        if (!length || !GetSystemCpuSetInformation(reinterpret_cast<PSYSTEM_CPU_SET_INFORMATION>(buffer.data()), length, &length, GetCurrentProcess(), 0))
+        {
+            spdlog::error("Thread Placement: GetSystemCpuSetInformation failed.");
+            return;
+        }
+
+        struct CpuSet { ULONG id; BYTE efficiencyClass; BYTE cacheIndex; BYTE logicalIndex; WORD group; };
+        std::vector<CpuSet> sets;
+        BYTE maxEfficiencyClass = 0;
+        for (size_t offset = 0; offset < length;)
+        {
+            auto info = reinterpret_cast<PSYSTEM_CPU_SET_INFORMATION>(buffer.data() + offset);
+            if (info->Type == CpuSetInformation)
+            {
+                sets.push_back({ info->CpuSet.Id, info->CpuSet.EfficiencyClass, info->CpuSet.LastLevelCacheIndex, info->CpuSet.LogicalProcessorIndex, info->CpuSet.Group });
+                maxEfficiencyClass = std::max(maxEfficiencyClass, info->CpuSet.EfficiencyClass);
+            }
+            offset += info->Size;
+        }
+
+        // Count the fastest cores per last level cache and keep the biggest cluster.
+        std::array<int, 256> coresPerCache{};
+        for (const auto& set : sets)
+        {
+            if (set.efficiencyClass == maxEfficiencyClass)
+            {
+                coresPerCache[set.cacheIndex]++;
+            }
+        }
+        BYTE preferredCache = (BYTE)(std::max_element(coresPerCache.begin(), coresPerCache.end()) - coresPerCache.begin());
+
+        for (const auto& set : sets)
+        {
+            if (set.efficiencyClass == maxEfficiencyClass && set.cacheIndex == preferredCache)
+            {
+                PreferredCpuSets.push_back(set.id);
+                if (set.group == 0 && set.logicalIndex < sizeof(KAFFINITY) * 8)
+                {
+                    PreferredAffinity |= (KAFFINITY)1 << set.logicalIndex;
+                }
+            }
+        }
+        bUniformTopology = PreferredCpuSets.size() == sets.size();
+
+        spdlog::info("Thread Placement: Detected {} logical processors, max efficiency class {}, {} in preferred cluster (cache {}).",
+            sets.size(), maxEfficiencyClass, PreferredCpuSets.size(), preferredCache);
+    }
+
+    void Place(HANDLE thread, const char* name, PlacementMode mode, int priority)
+    {
+        if (mode == PlacementMode::CpuSets && !bUniformTopology)
+        {
+            bool ok = SetThreadSelectedCpuSets(thread, PreferredCpuSets.data(), (ULONG)PreferredCpuSets.size());
+            spdlog::info("Thread Placement: {}: Restricted to {} preferred CPU sets: {}", name, PreferredCpuSets.size(), ok ? "OK" : "failed");
+        }
+        else if (mode == PlacementMode::Affinity && !bUniformTopology && PreferredAffinity)
+        {
+            bool ok = SetThreadAffinityMask(thread, PreferredAffinity) != 0;
+            spdlog::info("Thread Placement: {}: Affinity mask set to 0x{:x}: {}", name, PreferredAffinity, ok ? "OK" : "failed");
+        }
+        else if (mode != PlacementMode::None)
+        {
+            spdlog::info("Thread Placement: {}: All cores are equivalent, leaving core placement to the scheduler.", name);
+        }
+
+        if (priority != THREAD_PRIORITY_NORMAL)
+        {
+            bool ok = SetThreadPriority(thread, priority);
+            spdlog::info("Thread Placement: {}: Priority set to {}: {}", name, priority, ok ? "OK" : "failed");
+        }
+    }
+
+    // Frame times before and after placing the render thread are logged to show the effect.
+    constexpr uint64_t MeasureFrames = 600;
+    PlacementMode RenderMode = PlacementMode::None;
+    int iRenderPriority = THREAD_PRIORITY_NORMAL;
+    Frame::Window Before;
+    Frame::Window After;
+    bool bRenderPlaced = false;
+
+    // Called on the render thread for each new frame.
+    // Measures frame times for a while, places the render thread, then measures again.
+    void OnFrame()
+    {
+        if (After.count >= MeasureFrames || Frame::FrameCount == 0)
+        {
+            return;
+        }
+
+        double ms = Frame::LastFrametime * 1000.0;
+        if (!bRenderPlaced)
+        {
+            Before.Add(ms);
+            if (Before.count == MeasureFrames)
+            {
+                uintptr_t startAddress = GetStartAddress(GetCurrentThread());
+                spdlog::info("Thread Placement: Render thread is {} (start address exe+{:x}).", GetCurrentThreadId(), startAddress - (uintptr_t)GetModuleHandle(NULL));
+                Place(GetCurrentThread(), "Render thread", RenderMode, iRenderPriority);
+                bRenderPlaced = true;
+            }
+        }
+        else
+        {
+            After.Add(ms);
+            if (After.count == MeasureFrames)
+            {
+                spdlog::info("Thread Placement: Render thread frame time over {} frames: before {:.3f}ms +/- {:.3f}ms, after {:.3f}ms +/- {:.3f}ms.",
+                    MeasureFrames, Before.mean, Before.StdDev(), After.mean, After.StdDev());
+            }
+        }
+    }
+}
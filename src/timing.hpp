@@ -0,0 +1,199 @@
+#pragma once
+
+#include "stdafx.h"
+#include "frame.hpp"
+#include <spdlog/spdlog.h>
+
+namespace Timing
+{
+    using Sleep_t = void(WINAPI*)(DWORD);
+    using timeGetTime_t = DWORD(WINAPI*)();
+    using GetTickCount_t = DWORD(WINAPI*)();
+
+    Sleep_t Sleep_original = nullptr;
+    timeGetTime_t timeGetTime_original = nullptr;
+    GetTickCount_t GetTickCount_original = nullptr;
+
+    // How long to busy-wait at the end of each sleep. More spinning = less oversleep but more CPU time.
+    int64_t SpinTicks = 0;
+
+    // QPC-backed clocks are offset to continue from the value the original clock had at startup.
+    int64_t StartTicks = 0;
+    DWORD timeGetTimeStart = 0;
+    DWORD GetTickCountStart = 0;
+
+    struct SleepStats
+    {
+        std::atomic<uint64_t> calls = 0;
+        std::atomic<uint64_t> requestedUs = 0;
+        std::atomic<uint64_t> oversleptUs = 0;
+        std::atomic<uint64_t> maxOversleptUs = 0;
+
+        void Add(DWORD requestedMs, int64_t elapsedTicks)
+        {
+            uint64_t elapsedUs = (uint64_t)(Frame::ToSeconds(elapsedTicks) * 1000000.0);
+            uint64_t over = elapsedUs > requestedMs * 1000ull ? elapsedUs - requestedMs * 1000ull : 0;
+            calls++;
+            requestedUs += requestedMs * 1000ull;
+            oversleptUs += over;
+            for (uint64_t max = maxOversleptUs; over > max && !maxOversleptUs.compare_exchange_weak(max, over);) {}
+        }
+
+        void Log(const char* label)
+        {
+            uint64_t count = calls;
+            if (count)
+            {
+                spdlog::info("High Resolution Timers: {}: {} sleeps, avg requested {:.3f}ms, avg oversleep {:.3f}ms, max oversleep {:.3f}ms.",
+                    label, count, requestedUs / (double)count / 1000.0, oversleptUs / (double)count / 1000.0, maxOversleptUs / 1000.0);
+            }
+        }
+    };
+
+    SleepStats GameSleeps;
+    constexpr uint64_t LogInterval = 5000;
+
+    // Thread whose short sleeps are dropped, used to take the game's own frame limiter out of the loop.
+    std::atomic<DWORD> SkipSleepThreadId = 0;
+    constexpr DWORD SkipSleepMaxMs = 17;
+
+    // One high resolution timer per sleeping thread, closed when the thread exits.
+    struct ThreadTimer
+    {
+        HANDLE handle = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+        ~ThreadTimer()
+        {
+            if (handle)
+            {
+                CloseHandle(handle);
+            }
+        }
+    };
+
+    // Sleeps the calling thread until the given QPC tick.
+    void WaitUntil(int64_t target)
+    {
+        thread_local ThreadTimer threadTimer;
+        HANDLE timer = threadTimer.handle;
+
+        int64_t waitTicks = target - Frame::Now() - SpinTicks;
+        if (waitTicks > 0)
+        {
+            if (timer)
+            {
+                // Relative due time in 100ns units.
+                LARGE_INTEGER dueTime{ .QuadPart = -(int64_t)(Frame::ToSeconds(waitTicks) * 10000000.0) };
+                if (SetWaitableTimerEx(timer, &dueTime, 0, nullptr, nullptr, nullptr, 0))
+                {
+                    WaitForSingleObject(timer, INFINITE);
+                }
+            }
+            else
+            {
+                // High resolution timers need Windows 10 1803+. Fall back to a whole-millisecond sleep.
+                Sleep_original((DWORD)(Frame::ToSeconds(waitTicks) * 1000.0));
+            }
+        }
+
+        while (Frame::Now() < target)
+        {
+            YieldProcessor();
+        }
+    }
+
+    void PreciseSleep(DWORD ms)
+    {
+        WaitUntil(Frame::Now() + (int64_t)(ms * (Frame::Frequency.QuadPart / 1000)));
+    }
+
+    void WINAPI Sleep_hooked(DWORD ms)
+    {
+        // Sleep(0) is a yield and INFINITE never returns, leave both alone.
+        if (ms == 0 || ms == INFINITE)
+        {
+            Sleep_original(ms);
+            return;
+        }
+
+        if (ms <= SkipSleepMaxMs && GetCurrentThreadId() == SkipSleepThreadId)
+        {
+            Sleep_original(0);
+            return;
+        }
+
+        int64_t start = Frame::Now();
+        PreciseSleep(ms);
+        GameSleeps.Add(ms, Frame::Now() - start);
+
+        if (GameSleeps.calls % LogInterval == 0)
+        {
+            GameSleeps.Log("Game");
+        }
+    }
+
+    // Stands in for Sleep_hooked when the timers aren't replaced: drops the frame limiter sleep and leaves every other sleep alone.
+    void WINAPI SkipSleep_hooked(DWORD ms)
+    {
+        if (ms != 0 && ms <= SkipSleepMaxMs && GetCurrentThreadId() == SkipSleepThreadId)
+        {
+            Sleep_original(0);
+            return;
+        }
+        Sleep_original(ms);
+    }
+
+    DWORD WINAPI timeGetTime_hooked()
+    {
+        return timeGetTimeStart + (DWORD)(Frame::ToSeconds(Frame::Now() - StartTicks) * 1000.0);
+    }
+
+    DWORD WINAPI GetTickCount_hooked()
+    {
+        return GetTickCountStart + (DWORD)(Frame::ToSeconds(Frame::Now() - StartTicks) * 1000.0);
+    }
+
+    // Measures the oversleep of the original Sleep against the replacement so the difference shows up in the log.
+    // Takes a few hundred milliseconds, run it off the thread that installs the hooks.
+    void Calibrate()
+    {
+        constexpr int Samples = 20;
+        SleepStats original;
+        SleepStats replacement;
+        for (int i = 0; i < Samples; i++)
+        {
+            int64_t start = Frame::Now();
+            Sleep_original(1);
+            original.Add(1, Frame::Now() - start);
+
+            start = Frame::Now();
+            PreciseSleep(1);
+            replacement.Add(1, Frame::Now() - start);
+        }
+        original.Log("Sleep(1) before");
+        replacement.Log("Sleep(1) after");
+    }
+
+    void Init(int spinMicroseconds)
+    {
+        Frame::ToSeconds(0); // Initialises the QPC frequency.
+        SpinTicks = spinMicroseconds * Frame::Frequency.QuadPart / 1000000;
+        StartTicks = Frame::Now();
+
+        Sleep_original = reinterpret_cast<Sleep_t>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "Sleep"));
+        GetTickCount_original = reinterpret_cast<GetTickCount_t>(GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "GetTickCount"));
+        if (HMODULE winmm = GetModuleHandleW(L"winmm.dll"))
+        {
+            timeGetTime_original = reinterpret_cast<timeGetTime_t>(GetProcAddress(winmm, "timeGetTime"));
+        }
+
+        if (timeGetTime_original)
+        {
+            timeGetTimeStart = timeGetTime_original();
+        }
+        if (GetTickCount_original)
+        {
+            GetTickCountStart = GetTickCount_original();
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Hook trace file layout, shared by Hooks::Trace and tools/replay.
+// Little-endian, records back to back after the header:
+//   Header:       char[4] "SO4T", u16 version, u16 sizeof(SafetyHookContext), u64 QPC frequency
+//   HookRecord:   u8 RecordHook, u16 id, u16 name length, name, u16 probe count, probes { u16 reg, i32 offset, u16 size }
+//   InputsRecord: u8 RecordInputs, u16 size, Callbacks::Inputs. Holds for every call record after it.
+//   CallRecord:   u8 RecordCall, u16 id, u32 thread id, u64 QPC at entry, u32 callback duration in QPC ticks,
+//                 context before, probes before { u8 valid, bytes },
+//                 u64 mask of 8-byte context words that changed, changed words, probes after { u8 valid, bytes }
+namespace TraceFormat
+{
+    constexpr char Magic[4] = { 'S', 'O', '4', 'T' };
+    constexpr uint16_t Version = 2;
+    constexpr uint8_t RecordHook = 1;
+    constexpr uint8_t RecordCall = 2;
+    constexpr uint8_t RecordInputs = 3;
+}
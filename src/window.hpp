@@ -0,0 +1,155 @@
+#pragma once
+
+#include "stdafx.h"
+#include <spdlog/spdlog.h>
+
+namespace WindowState
+{
+    constexpr LONG RemovedStyle = WS_CAPTION | WS_THICKFRAME | WS_MINIMIZE | WS_MAXIMIZE | WS_SYSMENU;
+    constexpr LONG RemovedExStyle = WS_EX_DLGMODALFRAME | WS_EX_CLIENTEDGE | WS_EX_STATICEDGE;
+
+    // What was last applied to the game window. The window itself is always checked before writing,
+    // this is only used to notice the window changing monitor.
+    struct State
+    {
+        HWND window;
+        HMONITOR monitor;
+        RECT rect;
+    };
+
+    State Applied{};
+    thread_local bool bApplying = false;
+
+    std::atomic<uint64_t> Updates = 0;
+    std::atomic<uint64_t> StyleWrites = 0;
+    std::atomic<uint64_t> SkippedStyleWrites = 0;
+    std::atomic<uint64_t> Resizes = 0;
+    std::atomic<uint64_t> AvoidedResizes = 0;
+
+    LONG Borderless(int index, LONG value)
+    {
+        return index == GWL_STYLE ? value & ~RemovedStyle : index == GWL_EXSTYLE ? value & ~RemovedExStyle : value;
+    }
+
+    bool Owns(HWND hWnd)
+    {
+        return hWnd && hWnd == Applied.window;
+    }
+
+    // The full area of whichever monitor the window is mostly on.
+    bool TargetRect(HWND hWnd, HMONITOR& monitor, RECT& rect)
+    {
+        monitor = MonitorFromWindow(hWnd, MONITOR_DEFAULTTONEAREST);
+        MONITORINFO info{ sizeof(info) };
+        if (!GetMonitorInfoW(monitor, &info))
+        {
+            return false;
+        }
+        rect = info.rcMonitor;
+        return true;
+    }
+
+    // Brings the window to borderless fullscreen on its monitor. Styles are only written if they differ and
+    // everything else goes in a single SetWindowPos, so at most one resize reaches the game's swapchain.
+    // bStyleChanged is set when the caller already changed the style, which still needs SWP_FRAMECHANGED to take effect.
+    void Apply(HWND hWnd, bool bStyleChanged = false)
+    {
+        if (bApplying)
+        {
+            return;
+        }
+        bApplying = true;
+        Updates++;
+
+        bool bFrameChanged = bStyleChanged;
+        for (int index : { GWL_STYLE, GWL_EXSTYLE })
+        {
+            LONG current = GetWindowLongW(hWnd, index);
+            LONG target = Borderless(index, current);
+            if (current != target)
+            {
+                SetWindowLongW(hWnd, index, target);
+                StyleWrites++;
+                bFrameChanged = true;
+            }
+            else
+            {
+                SkippedStyleWrites++;
+            }
+        }
+
+        HMONITOR monitor = nullptr;
+        RECT target{};
+        RECT current{};
+        if (TargetRect(hWnd, monitor, target) && GetWindowRect(hWnd, &current))
+        {
+            int width = target.right - target.left;
+            int height = target.bottom - target.top;
+            bool bMove = current.left != target.left || current.top != target.top;
+            bool bResize = current.right - current.left != width || current.bottom - current.top != height;
+            if (bMove || bResize || bFrameChanged)
+            {
+                UINT flags = (bMove ? 0 : SWP_NOMOVE) | (bResize ? 0 : SWP_NOSIZE) | (bFrameChanged ? SWP_FRAMECHANGED : 0);
+                SetWindowPos(hWnd, HWND_TOP, target.left, target.top, width, height, flags);
+            }
+
+            // A frame change alone keeps the size, so it doesn't reach the swapchain as a resize.
+            if (bResize)
+            {
+                Resizes++;
+            }
+            else
+            {
+                AvoidedResizes++;
+            }
+
+            if (hWnd != Applied.window || monitor != Applied.monitor || !EqualRect(&target, &Applied.rect))
+            {
+                spdlog::info("Window State: Borderless on monitor {}x{} at {},{}.", width, height, target.left, target.top);
+            }
+            Applied = { hWnd, monitor, target };
+        }
+
+        bApplying = false;
+    }
+
+    // Keeps the game's own SetWindowPos calls on the tracked window from undoing the borderless placement.
+    void Clamp(HWND hWnd, int& x, int& y, int& cx, int& cy, UINT& flags)
+    {
+        if (bApplying || !Owns(hWnd))
+        {
+            return;
+        }
+
+        HMONITOR monitor = nullptr;
+        RECT target{};
+        RECT current{};
+        if (!TargetRect(hWnd, monitor, target) || !GetWindowRect(hWnd, &current))
+        {
+            return;
+        }
+
+        x = target.left;
+        y = target.top;
+        cx = target.right - target.left;
+        cy = target.bottom - target.top;
+        if (current.left == target.left && current.top == target.top)
+        {
+            flags |= SWP_NOMOVE;
+        }
+        if (!(flags & SWP_NOSIZE) && current.right - current.left == cx && current.bottom - current.top == cy)
+        {
+            flags |= SWP_NOSIZE;
+            AvoidedResizes++;
+        }
+    }
+
+    void Report()
+    {
+        if (Updates)
+        {
+            spdlog::info("Window State: {} updates, {} style writes ({} skipped), {} resizes, {} resizes avoided.",
+                Updates.load(), StyleWrites.load(), SkippedStyleWrites.load(), Resizes.load(), AvoidedResizes.load());
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Checks shared by the tools' test programs. A failed check prints what it expected and is counted;
+// Result() prints the summary and gives the exit code.
+
+#include <atomic>
+#include <cstdio>
+
+namespace Tests
+{
+    std::atomic<int> Failures = 0;
+
+    // Safe to call from several threads.
+    void Check(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            printf("FAIL: %s\n", what);
+            Failures++;
+        }
+    }
+
+    int Result(const char* name)
+    {
+        if (Failures)
+        {
+            printf("%d checks failed.\n", Failures.load());
+            return 1;
+        }
+        printf("All %s checks passed.\n", name);
+        return 0;
+    }
+}
@@ -0,0 +1,100 @@
+#include "reader.hpp"
+#include <chrono>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Maps the metrics block read-only. On Windows this is the game's own mapping; elsewhere a POSIX shared
+// memory object of the same layout, e.g. one a Wine bridge or the tests publish.
+const Metrics::Block* Open(const std::string& name, size_t& mappedSize)
+{
+#ifdef _WIN32
+    std::wstring wideName(name.begin(), name.end());
+    HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, wideName.c_str());
+    if (!mapping)
+    {
+        return nullptr;
+    }
+    auto block = reinterpret_cast<const Metrics::Block*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    MEMORY_BASIC_INFORMATION info{};
+    mappedSize = block && VirtualQuery(block, &info, sizeof(info)) ? info.RegionSize : 0;
+    CloseHandle(mapping);
+    return block;
+#else
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+    mappedSize = (size_t)info.st_size;
+    void* block = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return block == MAP_FAILED ? nullptr : reinterpret_cast<const Metrics::Block*>(block);
+#endif
+}
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+    std::string name = "Local\\SO4Fix_Metrics";
+#else
+    std::string name = "/SO4Fix_Metrics";
+#endif
+    bool watch = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-w" || arg == "--watch")
+        {
+            watch = true;
+        }
+        else if (arg == "-h" || arg == "--help")
+        {
+            fprintf(stderr, "Usage: %s [-w] [shared memory name]\n", argv[0]);
+            return 2;
+        }
+        else
+        {
+            name = arg;
+        }
+    }
+
+    size_t mappedSize = 0;
+    const Metrics::Block* block = Open(name, mappedSize);
+    if (!block)
+    {
+        fprintf(stderr, "Could not open %s\n", name.c_str());
+        return 2;
+    }
+
+    do
+    {
+        MetricsReader::Snapshot snapshot;
+        std::string error;
+        if (!MetricsReader::Read(*block, mappedSize, snapshot, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        MetricsReader::Print(snapshot);
+        if (watch)
+        {
+            printf("\n");
+            fflush(stdout);
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    } while (watch);
+    return 0;
+}
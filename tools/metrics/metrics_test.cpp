@@ -0,0 +1,173 @@
+#include "reader.hpp"
+#include "../check.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Publishes blocks through POSIX shared memory and checks readers only ever see whole values.
+
+namespace
+{
+    using Tests::Check;
+
+    // A separate mapping of the same object per call, as a reader in another process would have.
+    Metrics::Block* Map(const std::string& name, bool create)
+    {
+        int fd = shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        if (create && ftruncate(fd, sizeof(Metrics::Block)) != 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+        void* block = mmap(nullptr, sizeof(Metrics::Block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        return block == MAP_FAILED ? nullptr : reinterpret_cast<Metrics::Block*>(block);
+    }
+
+    void TestHeader(Metrics::Block& block)
+    {
+        std::string error;
+        MetricsReader::Snapshot snapshot;
+        Check(!Metrics::Valid(block, sizeof(block)), "fresh zeroed block is not valid");
+
+        Metrics::Reset(block, 1234);
+        Check(Metrics::Valid(block, sizeof(block)), "reset block is valid");
+        Check(!Metrics::Valid(block, sizeof(block) - 1), "short mapping is rejected");
+        Check(MetricsReader::Read(block, sizeof(block), snapshot, error) && snapshot.processId == 1234 && !snapshot.busy, "reset block reads");
+
+        block.version = Metrics::Version + 1;
+        Check(!MetricsReader::Read(block, sizeof(block), snapshot, error), "other version is rejected");
+        block.version = Metrics::Version;
+        block.size = sizeof(block) + 64;
+        Check(!Metrics::Valid(block, sizeof(block)), "other size is rejected");
+    }
+
+    // What a crashed writer leaves behind: stale data and seqlocks stuck odd.
+    void TestStale(Metrics::Block& block)
+    {
+        memset(static_cast<void*>(&block), 0xFF, sizeof(block));
+        block.magic = Metrics::Magic;
+        block.version = Metrics::Version;
+        block.size = sizeof(block);
+        block.hookCount.store(2);
+        block.resolution.seq.store(2);
+
+        std::string error;
+        MetricsReader::Snapshot snapshot;
+        Check(MetricsReader::Read(block, sizeof(block), snapshot, error), "stale block still has a valid header");
+        Check(snapshot.busy == 4, "odd seqlocks are reported busy rather than read");
+
+        Metrics::Reset(block, 99);
+        Check(MetricsReader::Read(block, sizeof(block), snapshot, error) && !snapshot.busy, "reset clears stuck seqlocks");
+        Check(snapshot.frames.frameCount == 0 && snapshot.resolution.width == 0 && snapshot.hooks.empty(), "reset clears stale data");
+    }
+
+    void TestPublish(Metrics::Block& block)
+    {
+        Metrics::Reset(block, 7);
+        block.resolution.Write({ 3440, 1440, 3440.0f / 1440.0f, Metrics::Wider });
+        Metrics::HookRate rate{};
+        strcpy(rate.name, "Custom Resolution");
+        rate.totalCalls = 5;
+        rate.callsPerSecond = 2.5f;
+        block.hooks[0].Write(rate);
+        block.hookCount.store(1, std::memory_order_release);
+
+        std::string error;
+        MetricsReader::Snapshot snapshot;
+        Check(MetricsReader::Read(block, sizeof(block), snapshot, error), "published block reads");
+        Check(snapshot.resolution.width == 3440 && snapshot.resolution.height == 1440 && snapshot.resolution.aspectClass == Metrics::Wider, "resolution reads back");
+        Check(snapshot.hooks.size() == 1 && std::string(snapshot.hooks[0].name) == "Custom Resolution" && snapshot.hooks[0].totalCalls == 5, "hook rate reads back");
+    }
+
+    // A writer process publishes frames where every field holds the frame number, while this process reads
+    // through its own mapping. Any mix of two frames means a torn read got past the seqlock.
+    void TestConcurrent(const std::string& name)
+    {
+        constexpr uint64_t Frames = 200000;
+        Metrics::Block* writerBlock = Map(name, false);
+        Metrics::Block* readerBlock = Map(name, false);
+        Check(writerBlock && readerBlock, "second mappings open");
+        if (!writerBlock || !readerBlock)
+        {
+            return;
+        }
+        Metrics::Reset(*writerBlock, (uint32_t)getpid());
+
+        pid_t child = fork();
+        if (child == 0)
+        {
+            Metrics::Frames frames{};
+            for (uint64_t i = 1; i <= Frames; i++)
+            {
+                frames.frameCount = i;
+                frames.lastMs = frames.averageMs = (float)i;
+                for (float& ms : frames.historyMs)
+                {
+                    ms = (float)i;
+                }
+                writerBlock->frames.Write(frames);
+            }
+            _exit(0);
+        }
+
+        uint64_t reads = 0;
+        uint64_t torn = 0;
+        uint64_t last = 0;
+        bool bMonotonic = true;
+        int status = 0;
+        while (waitpid(child, &status, WNOHANG) == 0)
+        {
+            Metrics::Frames frames{};
+            if (!readerBlock->frames.Read(frames))
+            {
+                continue;
+            }
+            reads++;
+            bool bWhole = frames.lastMs == (float)frames.frameCount && frames.averageMs == (float)frames.frameCount;
+            for (float ms : frames.historyMs)
+            {
+                bWhole = bWhole && ms == (float)frames.frameCount;
+            }
+            torn += !bWhole;
+            bMonotonic = bMonotonic && frames.frameCount >= last;
+            last = frames.frameCount;
+        }
+
+        Metrics::Frames final{};
+        Check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "writer process exits cleanly");
+        Check(reads > 0, "reader saw frames while the writer ran");
+        Check(torn == 0, "no torn frame reads");
+        Check(bMonotonic, "frame count never goes backwards");
+        Check(readerBlock->frames.Read(final) && final.frameCount == Frames, "last frame is visible through the other mapping");
+        printf("%llu concurrent reads, %llu torn.\n", (unsigned long long)reads, (unsigned long long)torn);
+
+        munmap(writerBlock, sizeof(Metrics::Block));
+        munmap(readerBlock, sizeof(Metrics::Block));
+    }
+}
+
+int main()
+{
+    std::string name = "/so4fix-metrics-test-" + std::to_string(getpid());
+    Metrics::Block* block = Map(name, true);
+    if (!block)
+    {
+        printf("FAIL: could not create shared memory %s\n", name.c_str());
+        return 1;
+    }
+
+    TestHeader(*block);
+    TestStale(*block);
+    TestPublish(*block);
+    TestConcurrent(name);
+
+    munmap(block, sizeof(Metrics::Block));
+    shm_unlink(name.c_str());
+    return Tests::Result("metrics");
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// Reads a live metrics block (see src/metrics_layout.hpp) through its seqlocks.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../../src/metrics_layout.hpp"
+
+namespace MetricsReader
+{
+    struct Snapshot
+    {
+        uint32_t processId = 0;
+        Metrics::Resolution resolution{};
+        Metrics::Startup startup{};
+        Metrics::Frames frames{};
+        std::vector<Metrics::HookRate> hooks;
+        int busy = 0; // Fields the writer held for every retry and were left out.
+    };
+
+    bool Read(const Metrics::Block& block, size_t mappedSize, Snapshot& out, std::string& error)
+    {
+        if (!Metrics::Valid(block, mappedSize))
+        {
+            error = "No live metrics block (wrong magic, version or size, or the game is still starting).";
+            return false;
+        }
+
+        out = {};
+        out.processId = block.processId;
+        out.busy += !block.resolution.Read(out.resolution);
+        out.busy += !block.startup.Read(out.startup);
+        out.busy += !block.frames.Read(out.frames);
+
+        uint32_t hookCount = std::min<uint32_t>(block.hookCount.load(std::memory_order_acquire), (uint32_t)Metrics::MaxHooks);
+        for (uint32_t i = 0; i < hookCount; i++)
+        {
+            Metrics::HookRate rate{};
+            if (block.hooks[i].Read(rate))
+            {
+                rate.name[sizeof(rate.name) - 1] = '\0';
+                out.hooks.push_back(rate);
+            }
+            else
+            {
+                out.busy++;
+            }
+        }
+        return true;
+    }
+
+    void Print(const Snapshot& snapshot)
+    {
+        static const char* AspectClasses[] = { "native", "wider", "narrower" };
+        const auto& res = snapshot.resolution;
+        printf("Process %u\n", snapshot.processId);
+        printf("Resolution: %dx%d, aspect %.3f (%s)\n", res.width, res.height, res.aspectRatio,
+            res.aspectClass < 3 ? AspectClasses[res.aspectClass] : "unknown");
+        printf("Startup: %.1f ms, %u pattern scans in %.1f ms, %u hooks\n", snapshot.startup.startupMs,
+            snapshot.startup.patternScans, snapshot.startup.patternScanMs, snapshot.startup.hooks);
+        printf("Frames: %llu, last %.2f ms, average %.2f ms\n", (unsigned long long)snapshot.frames.frameCount,
+            snapshot.frames.lastMs, snapshot.frames.averageMs);
+        for (const auto& hook : snapshot.hooks)
+        {
+            printf("  %-48s %12llu calls %10.1f/s\n", hook.name, (unsigned long long)hook.totalCalls, hook.callsPerSecond);
+        }
+        if (snapshot.busy)
+        {
+            printf("%d fields were mid-write on every retry.\n", snapshot.busy);
+        }
+    }
+}
@@ -0,0 +1,167 @@
+#include "../../src/pool_core.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+// Compares the size-class pool with the system allocator on a game-like mix: mostly small, short lived
+// allocations from several threads, every eighth handed to the next thread to free.
+// Usage: so4fix-pool-bench [threads] [operations per thread]
+
+namespace
+{
+    struct Allocator
+    {
+        const char* name;
+        void* (*allocate)(size_t);
+        void (*free)(void*);
+    };
+
+    void* PoolAllocate(size_t size)
+    {
+        void* p = Pool::Allocate(size);
+        return p ? p : malloc(size);
+    }
+
+    void PoolFree(void* p)
+    {
+        if (Pool::Owns(p))
+        {
+            Pool::Free(p);
+            return;
+        }
+        free(p);
+    }
+
+    // Sizes are drawn up front so both allocators see the same sequence and the RNG stays out of the timing.
+    std::vector<uint32_t> Sizes(unsigned seed, size_t count)
+    {
+        std::mt19937 rng(seed);
+        std::vector<uint32_t> sizes(count);
+        for (auto& size : sizes)
+        {
+            uint32_t roll = rng() % 100;
+            size = roll < 70 ? 8 + rng() % 120 : roll < 95 ? 128 + rng() % 896 : 1024 + rng() % 3072;
+        }
+        return sizes;
+    }
+
+    // Blocks waiting to be freed by the thread that owns the queue.
+    struct Handoff
+    {
+        std::mutex mutex;
+        std::vector<void*> blocks;
+    };
+
+    void Drain(const Allocator& allocator, Handoff& handoff)
+    {
+        std::vector<void*> blocks;
+        {
+            std::scoped_lock lock{ handoff.mutex };
+            blocks.swap(handoff.blocks);
+        }
+        for (void* p : blocks)
+        {
+            allocator.free(p);
+        }
+    }
+
+    // Keeps a rolling window of live blocks and frees the oldest as new ones come in. With more than one thread,
+    // every eighth block is freed by the next thread instead, which picks them up every 64 allocations.
+    void Run(const Allocator& allocator, const std::vector<uint32_t>& sizes, std::vector<Handoff>& handoffs, size_t index)
+    {
+        constexpr size_t Window = 256;
+        Handoff* next = handoffs.size() > 1 ? &handoffs[(index + 1) % handoffs.size()] : nullptr;
+        std::vector<void*> live(Window, nullptr);
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            void*& slot = live[i % Window];
+            if (next && slot && i % 8 == 0)
+            {
+                std::scoped_lock lock{ next->mutex };
+                next->blocks.push_back(slot);
+            }
+            else
+            {
+                allocator.free(slot);
+            }
+            slot = allocator.allocate(sizes[i]);
+            static_cast<uint8_t*>(slot)[0] = (uint8_t)i;
+
+            if (next && i % 64 == 0)
+            {
+                Drain(allocator, handoffs[index]);
+            }
+        }
+        for (void* p : live)
+        {
+            allocator.free(p);
+        }
+    }
+
+    double Measure(const Allocator& allocator, int threads, size_t operations)
+    {
+        std::vector<std::vector<uint32_t>> sizes;
+        for (int i = 0; i < threads; i++)
+        {
+            sizes.push_back(Sizes(100 + i, operations));
+        }
+
+        std::vector<Handoff> handoffs(threads);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; i++)
+        {
+            workers.emplace_back(Run, std::cref(allocator), std::cref(sizes[i]), std::ref(handoffs), (size_t)i);
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        // Whatever was handed off after its owner's last pass.
+        for (auto& handoff : handoffs)
+        {
+            Drain(allocator, handoff);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        return ns / (threads * (double)operations);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int threads = argc > 1 ? std::max(1, atoi(argv[1])) : (int)std::max(1u, std::thread::hardware_concurrency());
+    size_t operations = argc > 2 ? (size_t)std::max(1, atoi(argv[2])) : 2000000;
+    if (!Pool::Reserve(1024ull * 1024 * 1024))
+    {
+        fprintf(stderr, "Could not reserve the pool.\n");
+        return 2;
+    }
+
+    Allocator allocators[] = {
+        { "malloc/free", malloc, free },
+        { "Pool", PoolAllocate, PoolFree },
+    };
+
+    printf("%d threads, %zu allocations each.\n", threads, operations);
+    for (int single = 1; single >= 0; single--)
+    {
+        int count = single ? 1 : threads;
+        for (const auto& allocator : allocators)
+        {
+            printf("%-12s %2d thread%s: %7.1f ns per allocate/free pair\n", allocator.name, count, count == 1 ? " " : "s",
+                Measure(allocator, count, operations));
+        }
+    }
+
+    uint64_t spans = 0;
+    for (const auto& stats : Pool::Stats)
+    {
+        spans += stats.spans;
+    }
+    printf("Pool committed %.1f MB in %llu spans.\n", spans * Pool::SpanSize / (1024.0 * 1024.0), (unsigned long long)spans);
+    return 0;
+}
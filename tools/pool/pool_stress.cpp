@@ -0,0 +1,270 @@
+#include "../../src/pool_core.hpp"
+#include "../check.hpp"
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+
+// Hammers the size-class pool from several threads, freeing most blocks on a different thread from the one
+// that allocated them, and checks no block is handed out twice or loses its contents.
+// With --out-of-space the pool is kept tiny to check allocations fail cleanly once it is full.
+
+namespace
+{
+    using Tests::Check;
+
+    struct Block
+    {
+        uint8_t* p;
+        size_t size;
+        uint8_t fill;
+    };
+
+    bool Intact(const Block& block)
+    {
+        for (size_t i = 0; i < block.size; i++)
+        {
+            if (block.p[i] != block.fill)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Blocks passed between threads, so frees mostly land in another thread's cache.
+    std::mutex ExchangeMutex;
+    std::deque<Block> Exchange;
+
+    void TestClasses()
+    {
+        for (size_t size : { 0, 1, 15, 16, 17, 100, 1000, 4000, 4096 })
+        {
+            void* p = Pool::Allocate(size);
+            Check(p && Pool::Owns(p), "small sizes come from the pool");
+            Check(p && Pool::SizeOf(p) >= std::max<size_t>(size, 1), "class holds the request");
+            Check(p && ((uintptr_t)p % 16) == 0, "blocks are 16 byte aligned");
+            Pool::Free(p);
+        }
+        Check(!Pool::Allocate(Pool::MaxSmallSize + 1), "large sizes are left to the original allocator");
+        Check(!Pool::Owns(&Tests::Failures), "memory outside the region isn't claimed");
+    }
+
+    void TestZeroing()
+    {
+        // Dirty a block, free it and get it back zeroed: the whole class, not just the request.
+        auto dirty = reinterpret_cast<uint8_t*>(Pool::Allocate(40));
+        memset(dirty, 0xAB, Pool::SizeOf(dirty));
+        Pool::Free(dirty);
+
+        auto p = reinterpret_cast<uint8_t*>(Pool::AllocateZeroed(40));
+        Check(p == dirty, "freed block is reused first");
+        bool bZero = true;
+        for (size_t i = 0; i < Pool::SizeOf(p); i++)
+        {
+            bZero = bZero && p[i] == 0;
+        }
+        Check(bZero, "zeroed allocations clear the whole class block");
+
+        // Growing with zeroing: old contents kept, everything past the old class zero.
+        memset(p, 0x5A, Pool::SizeOf(p));
+        size_t oldSize = Pool::SizeOf(p);
+        auto q = reinterpret_cast<uint8_t*>(Pool::Reallocate(p, 1000, true));
+        bool bKept = true;
+        bZero = true;
+        for (size_t i = 0; i < Pool::SizeOf(q); i++)
+        {
+            if (i < oldSize)
+            {
+                bKept = bKept && q[i] == 0x5A;
+            }
+            else
+            {
+                bZero = bZero && q[i] == 0;
+            }
+        }
+        Check(q != p && bKept && bZero, "zeroing realloc keeps the old block and clears the rest");
+
+        Check(Pool::Reallocate(q, 900, false) == q, "realloc within the class stays in place");
+        auto r = reinterpret_cast<uint8_t*>(Pool::Reallocate(q, 100, false));
+        Check(r != q && r[0] == 0x5A && r[99] == 0, "realloc shrinks to a smaller class once under half used");
+        Pool::Free(r);
+    }
+
+    void Worker(unsigned seed, int iterations)
+    {
+        std::mt19937 rng(seed);
+        std::vector<Block> own;
+        for (int i = 0; i < iterations; i++)
+        {
+            uint32_t roll = rng() % 100;
+            if (roll < 35 || own.empty())
+            {
+                size_t size = rng() % 2 ? rng() % 128 : rng() % (Pool::MaxSmallSize + 1);
+                auto p = reinterpret_cast<uint8_t*>(roll % 5 ? Pool::Allocate(size) : Pool::AllocateZeroed(size));
+                if (!p)
+                {
+                    Check(false, "allocation failed with space left");
+                    continue;
+                }
+                Block block{ p, size, (uint8_t)(rng() | 1) };
+                memset(p, block.fill, size);
+                own.push_back(block);
+            }
+            else if (roll < 50)
+            {
+                Block block = own.back();
+                own.pop_back();
+                size_t size = rng() % (Pool::MaxSmallSize + 1);
+                Check(Intact(block), "contents survive until realloc");
+                auto p = reinterpret_cast<uint8_t*>(Pool::Reallocate(block.p, size, false));
+                if (!p)
+                {
+                    Check(false, "realloc failed with space left");
+                    continue;
+                }
+                block = { p, std::min(block.size, size), block.fill };
+                Check(Intact(block), "realloc keeps the contents");
+                block.size = size;
+                memset(p, block.fill, size);
+                own.push_back(block);
+            }
+            else if (roll < 70)
+            {
+                std::scoped_lock lock{ ExchangeMutex };
+                Exchange.push_back(own.back());
+                own.pop_back();
+            }
+            else if (roll < 80)
+            {
+                Check(Intact(own.back()), "contents survive until free");
+                Pool::Free(own.back().p);
+                own.pop_back();
+            }
+            else
+            {
+                Block block{};
+                {
+                    std::scoped_lock lock{ ExchangeMutex };
+                    if (Exchange.empty())
+                    {
+                        continue;
+                    }
+                    block = Exchange.front();
+                    Exchange.pop_front();
+                }
+                Check(Intact(block), "contents survive a cross-thread hand off");
+                Pool::Free(block.p);
+            }
+        }
+
+        for (const Block& block : own)
+        {
+            Check(Intact(block), "contents survive until free");
+            Pool::Free(block.p);
+        }
+    }
+
+    // Every live block at once: none may overlap.
+    void TestDisjoint()
+    {
+        std::vector<std::pair<uint8_t*, size_t>> blocks;
+        std::mt19937 rng(7);
+        for (int i = 0; i < 20000; i++)
+        {
+            size_t size = rng() % (Pool::MaxSmallSize + 1);
+            auto p = reinterpret_cast<uint8_t*>(Pool::Allocate(size));
+            if (p)
+            {
+                blocks.push_back({ p, Pool::SizeOf(p) });
+            }
+        }
+        std::sort(blocks.begin(), blocks.end());
+        bool bDisjoint = true;
+        for (size_t i = 1; i < blocks.size(); i++)
+        {
+            bDisjoint = bDisjoint && blocks[i - 1].first + blocks[i - 1].second <= blocks[i].first;
+        }
+        Check(bDisjoint, "live blocks never overlap");
+        for (const auto& [p, size] : blocks)
+        {
+            Pool::Free(p);
+        }
+    }
+
+    void TestOutOfSpace()
+    {
+        std::vector<void*> blocks;
+        while (void* p = Pool::Allocate(4096))
+        {
+            blocks.push_back(p);
+        }
+        Check(blocks.size() == 4 * Pool::SpanSize / 4096, "every span is handed out before the pool runs dry");
+        Check(Pool::OutOfSpace > 0, "running out of space is counted");
+        Check(!Pool::Allocate(4096), "allocations keep failing once full");
+
+        // Frees make room again for the same class without new spans.
+        Pool::Free(blocks.back());
+        blocks.pop_back();
+        void* p = Pool::Allocate(4096);
+        Check(p != nullptr, "freed blocks are reused when full");
+        blocks.push_back(p);
+        for (void* block : blocks)
+        {
+            Pool::Free(block);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool bOutOfSpace = argc > 1 && std::string(argv[1]) == "--out-of-space";
+    if (!Pool::Reserve(bOutOfSpace ? 4 * Pool::SpanSize : 256 * 1024 * 1024))
+    {
+        printf("FAIL: could not reserve the pool.\n");
+        return 1;
+    }
+
+    if (bOutOfSpace)
+    {
+        TestOutOfSpace();
+    }
+    else
+    {
+        TestClasses();
+        TestZeroing();
+        TestDisjoint();
+
+        constexpr int Threads = 8;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < Threads; i++)
+        {
+            threads.emplace_back(Worker, 1000 + i, 100000);
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        for (const Block& block : Exchange)
+        {
+            Check(Intact(block), "contents survive in the exchange");
+            Pool::Free(block.p);
+        }
+
+        // The workers' counts were published as they exited, this thread's are still pending.
+        Pool::PublishStats();
+        uint64_t allocs = 0;
+        uint64_t frees = 0;
+        for (const auto& stats : Pool::Stats)
+        {
+            allocs += stats.allocs;
+            frees += stats.frees;
+        }
+        Check(allocs == frees, "every allocation was freed exactly once");
+        printf("%llu allocations across %d threads.\n", (unsigned long long)allocs, Threads);
+    }
+
+    return Tests::Result("pool");
+}
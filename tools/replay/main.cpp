@@ -0,0 +1,45 @@
+#include "replay.hpp"
+#include <fstream>
+#include <iterator>
+
+int main(int argc, char** argv)
+{
+    const char* path = nullptr;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-v" || arg == "--verbose")
+        {
+            verbose = true;
+        }
+        else if (!path)
+        {
+            path = argv[i];
+        }
+    }
+
+    if (!path)
+    {
+        fprintf(stderr, "Usage: %s [-v] SO4Fix.trace\n", argv[0]);
+        return 2;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return 2;
+    }
+    std::vector<uint8_t> trace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Replay::Report report;
+    bool ok = Replay::Run(trace, report, verbose);
+    Replay::Print(report);
+    if (!ok)
+    {
+        fprintf(stderr, "%s\n", report.error.c_str());
+        return 2;
+    }
+    return report.mismatches ? 1 : 0;
+}
@@ -0,0 +1,375 @@
+#pragma once
+
+// Runs the mid hook callbacks against a hook trace (see src/trace_format.hpp) outside the game.
+// Every recorded call is rebuilt, the callback is run on it, and the resulting context and probed
+// memory are compared with what the callback produced in the game.
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include "../../src/callbacks.hpp"
+#include "../../src/trace_format.hpp"
+
+// Stand-ins for the settings dllmain.cpp defines. Set from the trace's inputs records.
+int iCustomResX;
+int iCustomResY;
+bool bFixHUD;
+bool bHighRefreshRate;
+float fAspectRatio;
+float fNativeAspect;
+float fAspectMultiplier;
+float fHUDWidth;
+float fCurrentFrametime;
+int iWindowMode;
+
+namespace Replay
+{
+    constexpr size_t ContextWords = sizeof(SafetyHookContext) / sizeof(uint64_t);
+
+    struct Probe
+    {
+        uint16_t reg;
+        int32_t offset;
+        uint16_t size;
+    };
+
+    struct Hook
+    {
+        std::string name;
+        safetyhook::MidHookFn callback = nullptr;
+        std::vector<Probe> probes;
+        uint64_t calls = 0;
+        uint64_t replayed = 0;
+        uint64_t skipped = 0;    // Probed memory wasn't readable in the game, so the call can't be rebuilt.
+        uint64_t mismatches = 0;
+        double recordedNs = 0.0; // Totals, callback time only.
+        double replayedNs = 0.0;
+    };
+
+    struct Report
+    {
+        std::map<uint16_t, Hook> hooks;
+        uint64_t calls = 0;
+        uint64_t mismatches = 0;
+        uint64_t unknownCalls = 0; // Calls to hooks with no callback of that name in this build.
+        std::string error;
+    };
+
+    struct Reader
+    {
+        const std::vector<uint8_t>& data;
+        size_t pos = 0;
+
+        bool Bytes(void* out, size_t size)
+        {
+            if (pos + size > data.size())
+            {
+                return false;
+            }
+            memcpy(out, data.data() + pos, size);
+            pos += size;
+            return true;
+        }
+
+        template<typename T>
+        bool Get(T& value)
+        {
+            return Bytes(&value, sizeof(T));
+        }
+
+        bool AtEnd() const { return pos >= data.size(); }
+    };
+
+    // Probe bytes as recorded: { u8 valid, bytes } per probe.
+    struct ProbeData
+    {
+        bool valid = false;
+        std::vector<uint8_t> bytes;
+    };
+
+    bool ReadProbes(Reader& reader, const std::vector<Probe>& probes, std::vector<ProbeData>& out)
+    {
+        out.resize(probes.size());
+        for (size_t i = 0; i < probes.size(); i++)
+        {
+            uint8_t valid = 0;
+            out[i].bytes.resize(probes[i].size);
+            if (!reader.Get(valid) || !reader.Bytes(out[i].bytes.data(), probes[i].size))
+            {
+                return false;
+            }
+            out[i].valid = valid != 0;
+        }
+        return true;
+    }
+
+    // Time taken by a pair of clock reads, taken off every measurement.
+    double ClockOverheadNs()
+    {
+        using Clock = std::chrono::steady_clock;
+        constexpr int Samples = 1000;
+        auto start = Clock::now();
+        for (int i = 0; i < Samples; i++)
+        {
+            auto a = Clock::now();
+            auto b = Clock::now();
+            (void)(b - a);
+        }
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Samples / 2.0;
+    }
+
+    // Rebuilds the call, runs the callback and compares. Returns false on a mismatch.
+    bool ReplayCall(Hook& hook, const SafetyHookContext& before, const std::vector<ProbeData>& probesBefore,
+        const std::array<uint64_t, ContextWords>& recordedAfter, uint64_t changed, const std::vector<ProbeData>& probesAfter,
+        double clockOverheadNs, bool verbose)
+    {
+        // One zeroed block per register covering all of its probes, with the register pointed so that
+        // reg + offset lands on the recorded bytes.
+        struct Region
+        {
+            int32_t start = INT32_MAX;
+            int32_t end = INT32_MIN;
+            std::vector<uint8_t> memory;
+        };
+        std::map<uint16_t, Region> regions;
+
+        SafetyHookContext ctx = before;
+        auto words = reinterpret_cast<uint64_t*>(&ctx);
+        for (size_t i = 0; i < hook.probes.size(); i++)
+        {
+            const Probe& probe = hook.probes[i];
+            uint64_t base = words[probe.reg / sizeof(uint64_t)];
+            if (!probesBefore[i].valid)
+            {
+                // A null register is left null for the callback's own check, anything else faulted in the game.
+                if (base)
+                {
+                    hook.skipped++;
+                    return true;
+                }
+                continue;
+            }
+            Region& region = regions[probe.reg];
+            region.start = std::min(region.start, probe.offset);
+            region.end = std::max(region.end, probe.offset + (int32_t)probe.size);
+        }
+
+        for (auto& [reg, region] : regions)
+        {
+            region.memory.assign(region.end - region.start, 0);
+            words[reg / sizeof(uint64_t)] = (uint64_t)(uintptr_t)(region.memory.data() - region.start);
+        }
+        for (size_t i = 0; i < hook.probes.size(); i++)
+        {
+            const Probe& probe = hook.probes[i];
+            if (probesBefore[i].valid)
+            {
+                Region& region = regions[probe.reg];
+                memcpy(region.memory.data() + (probe.offset - region.start), probesBefore[i].bytes.data(), probe.size);
+            }
+        }
+
+        // Words the callback didn't change in the game should come out as they went in, including rebased registers.
+        std::array<uint64_t, ContextWords> expected{};
+        for (size_t i = 0; i < ContextWords; i++)
+        {
+            expected[i] = (changed & (1ull << i)) ? recordedAfter[i] : words[i];
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        hook.callback(ctx);
+        auto end = std::chrono::steady_clock::now();
+        hook.replayedNs += std::max(0.0, std::chrono::duration<double, std::nano>(end - start).count() - clockOverheadNs);
+        hook.replayed++;
+
+        bool match = true;
+        for (size_t i = 0; i < ContextWords; i++)
+        {
+            if (words[i] != expected[i])
+            {
+                match = false;
+                if (verbose)
+                {
+                    printf("  %s: context +0x%zx: expected %016llx, got %016llx\n", hook.name.c_str(), i * sizeof(uint64_t),
+                        (unsigned long long)expected[i], (unsigned long long)words[i]);
+                }
+            }
+        }
+        for (size_t i = 0; i < hook.probes.size(); i++)
+        {
+            const Probe& probe = hook.probes[i];
+            if (!probesBefore[i].valid || !probesAfter[i].valid)
+            {
+                continue;
+            }
+            Region& region = regions[probe.reg];
+            if (memcmp(region.memory.data() + (probe.offset - region.start), probesAfter[i].bytes.data(), probe.size) != 0)
+            {
+                match = false;
+                if (verbose)
+                {
+                    printf("  %s: memory at register +0x%x, offset %d differs.\n", hook.name.c_str(), probe.reg, probe.offset);
+                }
+            }
+        }
+
+        hook.mismatches += !match;
+        return match;
+    }
+
+    bool Run(const std::vector<uint8_t>& trace, Report& report, bool verbose = false)
+    {
+        Reader reader{ trace };
+        char magic[4]{};
+        uint16_t version = 0;
+        uint16_t contextSize = 0;
+        uint64_t frequency = 0;
+        if (!reader.Bytes(magic, sizeof(magic)) || memcmp(magic, TraceFormat::Magic, sizeof(magic)) != 0 ||
+            !reader.Get(version) || !reader.Get(contextSize) || !reader.Get(frequency))
+        {
+            report.error = "Not a hook trace.";
+            return false;
+        }
+        if (version != TraceFormat::Version)
+        {
+            report.error = "Trace version " + std::to_string(version) + " is not supported, expected " + std::to_string(TraceFormat::Version) + ".";
+            return false;
+        }
+        if (contextSize != sizeof(SafetyHookContext) || !frequency)
+        {
+            report.error = "Trace was recorded with a " + std::to_string(contextSize) + " byte context, this build has " + std::to_string(sizeof(SafetyHookContext)) + ".";
+            return false;
+        }
+
+        double clockOverheadNs = ClockOverheadNs();
+        std::vector<ProbeData> probesBefore;
+        std::vector<ProbeData> probesAfter;
+        while (!reader.AtEnd())
+        {
+            uint8_t type = 0;
+            reader.Get(type);
+            if (type == TraceFormat::RecordHook)
+            {
+                uint16_t id = 0;
+                uint16_t nameLength = 0;
+                uint16_t probeCount = 0;
+                Hook hook;
+                if (!reader.Get(id) || !reader.Get(nameLength))
+                {
+                    break;
+                }
+                hook.name.resize(nameLength);
+                if (!reader.Bytes(hook.name.data(), nameLength) || !reader.Get(probeCount))
+                {
+                    break;
+                }
+                hook.probes.resize(probeCount);
+                bool ok = true;
+                for (auto& probe : hook.probes)
+                {
+                    ok = ok && reader.Get(probe.reg) && reader.Get(probe.offset) && reader.Get(probe.size);
+                    ok = ok && probe.reg + sizeof(uint64_t) <= sizeof(SafetyHookContext);
+                }
+                if (!ok)
+                {
+                    break;
+                }
+                hook.callback = Callbacks::Find(hook.name);
+                report.hooks[id] = std::move(hook);
+            }
+            else if (type == TraceFormat::RecordInputs)
+            {
+                uint16_t size = 0;
+                Callbacks::Inputs inputs{};
+                if (!reader.Get(size) || size != sizeof(inputs) || !reader.Get(inputs))
+                {
+                    report.error = "Inputs record doesn't match this build.";
+                    return false;
+                }
+                Callbacks::Apply(inputs);
+            }
+            else if (type == TraceFormat::RecordCall)
+            {
+                uint16_t id = 0;
+                uint32_t threadId = 0;
+                uint64_t start = 0;
+                uint32_t duration = 0;
+                SafetyHookContext before{};
+                uint64_t changed = 0;
+                if (!reader.Get(id) || !reader.Get(threadId) || !reader.Get(start) || !reader.Get(duration) || !reader.Get(before))
+                {
+                    break;
+                }
+
+                auto it = report.hooks.find(id);
+                if (it == report.hooks.end())
+                {
+                    report.error = "Call to hook " + std::to_string(id) + " before its hook record.";
+                    return false;
+                }
+                Hook& hook = it->second;
+
+                std::array<uint64_t, ContextWords> recordedAfter{};
+                if (!ReadProbes(reader, hook.probes, probesBefore) || !reader.Get(changed))
+                {
+                    break;
+                }
+                bool ok = true;
+                for (size_t i = 0; i < ContextWords && ok; i++)
+                {
+                    if (changed & (1ull << i))
+                    {
+                        ok = reader.Get(recordedAfter[i]);
+                    }
+                }
+                if (!ok || !ReadProbes(reader, hook.probes, probesAfter))
+                {
+                    break;
+                }
+
+                report.calls++;
+                hook.calls++;
+                hook.recordedNs += duration * 1000000000.0 / frequency;
+                if (!hook.callback)
+                {
+                    report.unknownCalls++;
+                    continue;
+                }
+                if (!ReplayCall(hook, before, probesBefore, recordedAfter, changed, probesAfter, clockOverheadNs, verbose))
+                {
+                    report.mismatches++;
+                }
+            }
+            else
+            {
+                report.error = "Unknown record type " + std::to_string(type) + " at offset " + std::to_string(reader.pos - 1) + ".";
+                return false;
+            }
+        }
+
+        if (!reader.AtEnd())
+        {
+            report.error = "Trace is truncated at offset " + std::to_string(reader.pos) + ".";
+            return false;
+        }
+        return true;
+    }
+
+    void Print(const Report& report)
+    {
+        printf("%-34s %10s %10s %8s %10s %12s %12s\n", "Hook", "Calls", "Replayed", "Skipped", "Mismatches", "Game ns", "Replay ns");
+        for (const auto& [id, hook] : report.hooks)
+        {
+            printf("%-34s %10llu %10llu %8llu %10llu %12.1f %12.1f%s\n", hook.name.c_str(),
+                (unsigned long long)hook.calls, (unsigned long long)hook.replayed, (unsigned long long)hook.skipped, (unsigned long long)hook.mismatches,
+                hook.calls ? hook.recordedNs / hook.calls : 0.0, hook.replayed ? hook.replayedNs / hook.replayed : 0.0,
+                hook.callback ? "" : "  (no callback in this build)");
+        }
+        printf("%llu calls, %llu mismatches, %llu calls to unknown hooks.\n",
+            (unsigned long long)report.calls, (unsigned long long)report.mismatches, (unsigned long long)report.unknownCalls);
+    }
+}
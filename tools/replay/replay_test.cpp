@@ -0,0 +1,190 @@
+#include "replay.hpp"
+#include "../check.hpp"
+#include <cstddef>
+
+// Builds small traces by hand and checks the replay rebuilds calls, applies inputs and catches changed behaviour.
+
+namespace
+{
+    using Tests::Check;
+
+    struct Writer
+    {
+        std::vector<uint8_t> out;
+
+        template<typename T>
+        void Put(const T& value)
+        {
+            auto bytes = reinterpret_cast<const uint8_t*>(&value);
+            out.insert(out.end(), bytes, bytes + sizeof(T));
+        }
+
+        void Header()
+        {
+            out.insert(out.end(), TraceFormat::Magic, TraceFormat::Magic + sizeof(TraceFormat::Magic));
+            Put(TraceFormat::Version);
+            Put((uint16_t)sizeof(SafetyHookContext));
+            Put((uint64_t)10000000);
+        }
+
+        void Hook(uint16_t id, const std::string& name, const std::vector<Replay::Probe>& probes)
+        {
+            Put(TraceFormat::RecordHook);
+            Put(id);
+            Put((uint16_t)name.size());
+            out.insert(out.end(), name.begin(), name.end());
+            Put((uint16_t)probes.size());
+            for (const auto& probe : probes)
+            {
+                Put(probe.reg);
+                Put(probe.offset);
+                Put(probe.size);
+            }
+        }
+
+        void Inputs(const Callbacks::Inputs& inputs)
+        {
+            Put(TraceFormat::RecordInputs);
+            Put((uint16_t)sizeof(inputs));
+            Put(inputs);
+        }
+
+        // probes are { valid, bytes } per probe, already laid out.
+        void Call(uint16_t id, const SafetyHookContext& before, const std::vector<uint8_t>& probesBefore,
+            const SafetyHookContext& after, const std::vector<uint8_t>& probesAfter)
+        {
+            Put(TraceFormat::RecordCall);
+            Put(id);
+            Put((uint32_t)1);
+            Put((uint64_t)0);
+            Put((uint32_t)5);
+            Put(before);
+            out.insert(out.end(), probesBefore.begin(), probesBefore.end());
+
+            auto wordsBefore = reinterpret_cast<const uint64_t*>(&before);
+            auto wordsAfter = reinterpret_cast<const uint64_t*>(&after);
+            uint64_t changed = 0;
+            for (size_t i = 0; i < Replay::ContextWords; i++)
+            {
+                changed |= (uint64_t)(wordsBefore[i] != wordsAfter[i]) << i;
+            }
+            Put(changed);
+            for (size_t i = 0; i < Replay::ContextWords; i++)
+            {
+                if (changed & (1ull << i))
+                {
+                    Put(wordsAfter[i]);
+                }
+            }
+            out.insert(out.end(), probesAfter.begin(), probesAfter.end());
+        }
+    };
+
+    Callbacks::Inputs Ultrawide()
+    {
+        Callbacks::Inputs inputs{};
+        inputs.customResX = 3440;
+        inputs.customResY = 1440;
+        inputs.aspectRatio = 3440.0f / 1440.0f;
+        inputs.nativeAspect = 16.0f / 9.0f;
+        inputs.aspectMultiplier = inputs.aspectRatio / inputs.nativeAspect;
+        inputs.hudWidth = 1440.0f * inputs.nativeAspect;
+        inputs.currentFrametime = 1.0f / 144.0f;
+        inputs.fixHUD = 1;
+        inputs.highRefreshRate = 1;
+        inputs.steps[0] = { 3, 1.0f / 60.0f };
+        return inputs;
+    }
+
+    std::vector<uint8_t> ProbeBytes(const std::vector<float>& values)
+    {
+        std::vector<uint8_t> out{ 1 };
+        auto bytes = reinterpret_cast<const uint8_t*>(values.data());
+        out.insert(out.end(), bytes, bytes + values.size() * sizeof(float));
+        return out;
+    }
+
+    std::vector<uint8_t> BuildTrace(bool corruptFOV)
+    {
+        Callbacks::Inputs inputs = Ultrawide();
+        float multiplier = inputs.aspectMultiplier;
+
+        Writer writer;
+        writer.Header();
+        writer.Hook(0, "FOV", {});
+        writer.Hook(1, "HUD: Movie", { { offsetof(SafetyHookContext, rbx), 0x0, 0x58 } });
+        writer.Hook(2, "High Refresh Rate: Timestep", {});
+        writer.Hook(3, "Not A Hook", {});
+        writer.Inputs(inputs);
+
+        // FOV scales xmm2 by 1 / multiplier.
+        SafetyHookContext before{};
+        before.xmm2.f32[0] = 1.0f;
+        before.rsp = 0x7FF000;
+        SafetyHookContext after = before;
+        after.xmm2.f32[0] = corruptFOV ? 1.0f : 1.0f * (1.0f / multiplier);
+        writer.Call(0, before, {}, after, {});
+
+        // Movie writes four floats through rbx, so rbx is rebuilt from the probe.
+        std::vector<float> quad(0x58 / sizeof(float), 0.5f);
+        std::vector<float> quadAfter = quad;
+        quadAfter[0x00 / 4] = -1.0f / multiplier;
+        quadAfter[0x1C / 4] = -1.0f / multiplier;
+        quadAfter[0x38 / 4] = 1.0f / multiplier;
+        quadAfter[0x54 / 4] = 1.0f / multiplier;
+        before = {};
+        before.rbx = 0x12340000;
+        writer.Call(1, before, ProbeBytes(quad), before, ProbeBytes(quadAfter));
+
+        // A pointer that faulted in the game can't be rebuilt.
+        std::vector<uint8_t> unreadable(1 + 0x58, 0);
+        writer.Call(1, before, unreadable, before, unreadable);
+
+        // Timestep rescales the 1/60 step in xmm3 to the frame time.
+        before = {};
+        before.xmm3.f32[0] = 1.0f / 60.0f;
+        after = before;
+        after.xmm3.f32[0] = (1.0f / 60.0f) * (1.0f / 144.0f) * 60.0f;
+        writer.Call(2, before, {}, after, {});
+
+        writer.Call(3, before, {}, before, {});
+        return writer.out;
+    }
+}
+
+int main()
+{
+    {
+        Replay::Report report;
+        bool ok = Replay::Run(BuildTrace(false), report);
+        Replay::Print(report);
+        Check(ok, "trace replays");
+        Check(report.calls == 5, "every call record is read");
+        Check(report.mismatches == 0, "recorded behaviour matches");
+        Check(report.unknownCalls == 1, "calls to unknown hooks are counted");
+        Check(report.hooks[1].replayed == 1 && report.hooks[1].skipped == 1, "unreadable probes are skipped");
+        Check(fAspectRatio == Ultrawide().aspectRatio, "inputs record is applied");
+    }
+
+    {
+        Replay::Report report;
+        Replay::Run(BuildTrace(true), report);
+        Check(report.mismatches == 1 && report.hooks[0].mismatches == 1, "changed behaviour is reported against its hook");
+    }
+
+    {
+        std::vector<uint8_t> trace = BuildTrace(false);
+        trace.resize(trace.size() - 3);
+        Replay::Report report;
+        Check(!Replay::Run(trace, report), "truncated trace is rejected");
+    }
+
+    {
+        std::vector<uint8_t> trace = BuildTrace(false);
+        trace[4] = 1;
+        Replay::Report report;
+        Check(!Replay::Run(trace, report), "old trace version is rejected");
+    }
+
+    return Tests::Result("replay");
+}